@@ -249,6 +249,62 @@ static uint8_t dbcs_prev_char = 0;
 static iconv_t cp_iconv_input = (iconv_t)(-1);
 static iconv_t cp_iconv_output = (iconv_t)(-1);
 
+// Lookup tables derived from the current codepage, so that no iconv call is
+// needed per character:
+//  dbcs_lead:    1 for DBCS lead bytes.
+//  dbcs_unicode: DBCS char (lead << 8 | trail) to unicode, 0 if invalid.
+//  dos_chars:    unicode to DOS char, as (length << 16) | (c1 << 8) | c2,
+//                filled on first use of each code-point, 0 if not known yet.
+static uint8_t dbcs_lead[256];
+static uint16_t *dbcs_unicode = NULL;
+static uint32_t *dos_chars = NULL;
+
+static void build_codepage_tables(void)
+{
+    int has_dbcs = 0;
+    memset(dbcs_lead, 0, sizeof(dbcs_lead));
+    for(int i = 0; i < 4; i++)
+    {
+        uint8_t lo = cp_dbcs[i * 2];
+        uint8_t hi = cp_dbcs[i * 2 + 1];
+        if(lo == 0 && hi == 0)
+            break;
+        for(int c = lo; c <= hi; c++)
+            dbcs_lead[c] = has_dbcs = 1;
+    }
+
+    free(dbcs_unicode);
+    dbcs_unicode = NULL;
+    if(has_dbcs)
+    {
+        dbcs_unicode = calloc(0x10000, sizeof(dbcs_unicode[0]));
+        if(!dbcs_unicode)
+            print_error("not enough memory for DBCS table\n");
+        for(int c1 = 0; c1 < 256 && cp_iconv_output != (iconv_t)(-1); c1++)
+        {
+            if(!dbcs_lead[c1])
+                continue;
+            for(int c2 = 0; c2 < 256; c2++)
+            {
+                uint8_t inbuf[2] = {c1, c2};
+                uint8_t outbuf[2];
+                char *src = (char *)inbuf, *dst = (char *)outbuf;
+                size_t srclen = sizeof(inbuf), dstlen = sizeof(outbuf);
+                if(iconv(cp_iconv_output, &src, &srclen, &dst, &dstlen) == (size_t)-1)
+                    continue;
+                if(sizeof(outbuf) - dstlen == 1)
+                    dbcs_unicode[(c1 << 8) | c2] = outbuf[0];
+                else
+                    dbcs_unicode[(c1 << 8) | c2] = (outbuf[0] << 8) | outbuf[1];
+            }
+        }
+    }
+
+    // The reverse table is filled on demand, see get_dos_char()
+    free(dos_chars);
+    dos_chars = NULL;
+}
+
 static void set_codepage_iconv()
 {
     if(cp_iconv_name)
@@ -273,6 +329,7 @@ static void set_codepage_iconv()
         free(names);
     }
     dbcs_prev_char = 0;
+    build_codepage_tables();
 }
 
 static int read_codepage_file(const char *fname)
@@ -399,16 +456,7 @@ void init_codepage(void)
 
 int check_dbcs_1st(uint8_t cp)
 {
-    for(int i = 0; i < 4; i++)
-    {
-        uint8_t lo = cp_dbcs[i * 2];
-        uint8_t hi = cp_dbcs[i * 2 + 1];
-        if(lo == 0 && hi == 0)
-            break;
-        if(lo <= cp && cp <= hi)
-            return 1;
-    }
-    return 0;
+    return dbcs_lead[cp];
 }
 
 /* Transforms a DOS char to Unicode */
@@ -416,30 +464,15 @@ int get_unicode(uint8_t cp, int *dbcs)
 {
     if(dbcs_prev_char)
     {
-        uint8_t inbuf[2];
-        uint8_t outbuf[2];
-        char *src, *dst;
-        size_t srclen, dstlen;
-        int s;
-
-        src = (char *)inbuf;
-        srclen = sizeof(inbuf);
-        dst = (char *)outbuf;
-        dstlen = sizeof(outbuf);
-
-        inbuf[0] = dbcs_prev_char;
-        inbuf[1] = cp;
+        int uc = dbcs_unicode[(dbcs_prev_char << 8) | cp];
         dbcs_prev_char = 0;
-        s = iconv(cp_iconv_output, &src, &srclen, &dst, &dstlen);
-        if(s == (size_t)-1)
+        if(!uc)
             return 0;
         if(dbcs)
             *dbcs = 1;
-        if(sizeof(outbuf) - dstlen == 1)
-            return outbuf[0];
-        return (outbuf[0] << 8) | outbuf[1];
+        return uc;
     }
-    else if(check_dbcs_1st(cp))
+    else if(dbcs_lead[cp])
     {
         dbcs_prev_char = cp;
         if(dbcs)
@@ -451,8 +484,8 @@ int get_unicode(uint8_t cp, int *dbcs)
     return cp_table[cp];
 }
 
-/* Transforms a Unicode code-point to the DOS char */
-int get_dos_char(int uc, int *c1, int *c2)
+/* Transforms a Unicode code-point to the DOS char, using iconv */
+static uint32_t search_dos_char(int uc)
 {
     uint8_t inbuf[2];
     uint8_t outbuf[2];
@@ -460,20 +493,6 @@ int get_dos_char(int uc, int *c1, int *c2)
     size_t srclen, dstlen;
     int s;
 
-    // TODO: faster searching
-    if(uc <= 0x0020)
-    {
-        *c1 = uc & 0xff;
-        return 1;
-    }
-    for(int i = 0; i < 256; i++)
-    {
-        if(uc == cp_table[i])
-        {
-            *c1 = i;
-            return 1;
-        }
-    }
     src = (char *)inbuf;
     srclen = sizeof(inbuf);
     dst = (char *)outbuf;
@@ -482,14 +501,54 @@ int get_dos_char(int uc, int *c1, int *c2)
     inbuf[1] = uc & 0xff;
     s = iconv(cp_iconv_input, &src, &srclen, &dst, &dstlen);
     if(s != (size_t)-1)
+        return ((sizeof(outbuf) - dstlen) << 16) | (outbuf[0] << 8) | outbuf[1];
+    // Assume space is always valid
+    return 0x10000 | (' ' << 8);
+}
+
+/* Transforms a Unicode code-point to the DOS char */
+int get_dos_char(int uc, int *c1, int *c2)
+{
+    if(uc <= 0x0020)
     {
-        *c1 = outbuf[0] & 0xFF;
-        *c2 = outbuf[1] & 0xFF;
-        return sizeof(outbuf) - dstlen;
+        *c1 = uc & 0xff;
+        return 1;
     }
-    // Assume space is always valid
-    *c1 = ' ';
-    return 1;
+    if(!dos_chars)
+    {
+        dos_chars = calloc(0x10000, sizeof(dos_chars[0]));
+        if(!dos_chars)
+            print_error("not enough memory for codepage table\n");
+        // Lowest DOS char wins if there are duplicates in the table
+        for(int i = 255; i >= 0; i--)
+            dos_chars[cp_table[i]] = 0x10000 | (i << 8);
+    }
+    uint32_t d;
+    if(uc > 0xFFFF)
+        d = search_dos_char(uc);
+    else if(!(d = dos_chars[uc]))
+        d = dos_chars[uc] = search_dos_char(uc);
+    *c1 = (d >> 8) & 0xFF;
+    if((d >> 16) == 2)
+        *c2 = d & 0xFF;
+    return d >> 16;
+}
+
+/* Returns the number of leading 7-bit ASCII bytes in the string */
+unsigned ascii_span(const uint8_t *str, unsigned len)
+{
+    unsigned i = 0;
+    // Test one word at a time
+    for(; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+    {
+        uint64_t w;
+        memcpy(&w, str + i, sizeof(w));
+        if(w & 0x8080808080808080ULL)
+            break;
+    }
+    while(i < len && str[i] < 0x80)
+        i++;
+    return i;
 }
 
 int utf8_to_unicode(const uint8_t **p)
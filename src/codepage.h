@@ -20,6 +20,9 @@ int get_unicode(uint8_t cp, int *dbcs);
 /* Transforms a Unicode code-point to the DOS char */
 int get_dos_char(int uc, int *c1, int *c2);
 
+/* Returns the number of leading 7-bit ASCII bytes in the string */
+unsigned ascii_span(const uint8_t *str, unsigned len);
+
 /* utf8 <-> unicode converter */
 int utf8_to_unicode(const uint8_t **p);
 void unicode_to_utf8(uint8_t **dst, int uc);
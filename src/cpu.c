@@ -5,10 +5,13 @@
 #include "dbg.h"
 #include "dis.h"
 #include "emu.h"
+#include "idle.h"
 #include "os.h"
+#include "pic.h"
 
 // Forward declarations
 static void do_instruction(uint8_t code);
+static void dispatch(uint8_t code, int chain);
 
 static uint16_t wregs[8];
 static uint16_t sregs[4];
@@ -27,6 +30,115 @@ static int segment_override;
 
 static uint8_t parity_table[256];
 
+/* Lazy flags: the ALU instructions only store the operation, operands and
+ * result; the arithmetic flags are computed from those when they are read.
+ * Instructions that modify the flags directly must call SyncFlags() first,
+ * this copies the pending values to the variables above. */
+enum
+{
+    LF_NONE = 0, /* CF, PF, AF, ZF, SF and OF are up to date */
+    LF_ADD,      /* ADD, ADC */
+    LF_SUB,      /* SUB, SBB, CMP, NEG */
+    LF_LOG,      /* AND, OR, XOR, TEST */
+    LF_INC,      /* INC, CF is not modified */
+    LF_DEC,      /* DEC, CF is not modified */
+    LF_BYTE = 0,
+    LF_WORD = 8
+};
+
+static unsigned lf_op, lf_dst, lf_src, lf_res;
+
+static void SetLazyFlags(unsigned op, unsigned dst, unsigned src, unsigned res)
+{
+    // INC and DEC keep the carry of the previous operation.
+    if((op & ~LF_WORD) >= LF_INC && (lf_op & ~LF_WORD) < LF_INC)
+    {
+        switch(lf_op & ~LF_WORD)
+        {
+        case LF_ADD:
+        case LF_SUB: CF = (lf_res >> ((lf_op & LF_WORD) ? 16 : 8)) & 1; break;
+        case LF_LOG: CF = 0; break;
+        }
+    }
+    lf_op = op;
+    lf_dst = dst;
+    lf_src = src;
+    lf_res = res;
+}
+
+static unsigned LazySign(void)
+{
+    return (lf_op & LF_WORD) ? 0x8000 : 0x80;
+}
+
+static int8_t GetCF(void)
+{
+    switch(lf_op & ~LF_WORD)
+    {
+    case LF_ADD:
+    case LF_SUB: return (lf_res >> ((lf_op & LF_WORD) ? 16 : 8)) & 1;
+    case LF_LOG: return 0;
+    default:     return CF;
+    }
+}
+
+static int8_t GetZF(void)
+{
+    if(lf_op == LF_NONE)
+        return ZF;
+    return !(lf_res & ((lf_op & LF_WORD) ? 0xFFFF : 0xFF));
+}
+
+static unsigned GetSF(void)
+{
+    if(lf_op == LF_NONE)
+        return SF;
+    return lf_res & LazySign();
+}
+
+static int8_t GetPF(void)
+{
+    if(lf_op == LF_NONE)
+        return PF;
+    return parity_table[lf_res & 0xFF];
+}
+
+static unsigned GetAF(void)
+{
+    switch(lf_op & ~LF_WORD)
+    {
+    case LF_NONE: return AF;
+    case LF_LOG:  return 0;
+    default:      return (lf_res ^ lf_src ^ lf_dst) & 0x10;
+    }
+}
+
+static unsigned GetOF(void)
+{
+    switch(lf_op & ~LF_WORD)
+    {
+    case LF_ADD:
+    case LF_INC: return (lf_res ^ lf_src) & (lf_res ^ lf_dst) & LazySign();
+    case LF_SUB:
+    case LF_DEC: return (lf_dst ^ lf_src) & (lf_dst ^ lf_res) & LazySign();
+    case LF_LOG: return 0;
+    default:     return OF;
+    }
+}
+
+static void SyncFlags(void)
+{
+    if(lf_op == LF_NONE)
+        return;
+    CF = GetCF();
+    PF = GetPF();
+    AF = GetAF();
+    ZF = GetZF();
+    SF = GetSF();
+    OF = GetOF();
+    lf_op = LF_NONE;
+}
+
 static uint8_t GetMemAbsB(uint32_t addr)
 {
     return get8(addr);
@@ -37,13 +149,18 @@ static uint16_t GetMemAbsW(uint32_t addr)
     return get16(addr);
 }
 
+/* Stores are counted in "idle_mem_changes", to tell polling loops from
+   loops doing work. Stack pushes are not counted (see PushWord), so that
+   a loop calling INT 1Ah or a subroutine to poll still looks idle.  */
 static void SetMemAbsB(uint32_t addr, uint8_t val)
 {
+    idle_mem_changes++;
     put8(addr, val);
 }
 
 static void SetMemAbsW(uint32_t addr, uint16_t val)
 {
+    idle_mem_changes++;
     put16(addr, val);
 }
 
@@ -111,17 +228,17 @@ static uint32_t GetAbsAddrSeg(int seg, uint16_t off)
 static void PushWord(uint16_t w)
 {
     wregs[SP] -= 2;
-    SetMemW(SS, wregs[SP], w);
+    put16(sregs[SS] * 16 + wregs[SP], w);
 }
 
 #ifdef CPU_PUSH_80286
 #define PUSH_SP()                                                              \
     PushWord(wregs[SP]);                                                       \
-    break;
+    NEXT_OP;
 #else
 #define PUSH_SP()                                                              \
     PushWord(wregs[SP] - 2);                                                   \
-    break;
+    NEXT_OP;
 #endif
 
 static uint16_t PopWord(void)
@@ -133,41 +250,33 @@ static uint16_t PopWord(void)
 
 #define PUSH_WR(reg)                                                           \
     PushWord(wregs[reg]);                                                      \
-    break;
+    NEXT_OP;
 #define POP_WR(reg)                                                            \
     wregs[reg] = PopWord();                                                    \
-    break;
+    NEXT_OP;
 
 #define XCHG_AX_WR(reg)                                                        \
     {                                                                          \
         uint16_t tmp = wregs[reg];                                             \
         wregs[reg] = wregs[AX];                                                \
         wregs[AX] = tmp;                                                       \
-        break;                                                                 \
+        NEXT_OP;                                                               \
     }
 
 #define INC_WR(reg)                                                            \
     {                                                                          \
         uint16_t tmp = wregs[reg] + 1;                                         \
-        OF = tmp == 0x8000;                                                    \
-        AF = (tmp ^ (tmp - 1)) & 0x10;                                         \
-        SetZFW(tmp);                                                           \
-        SetSFW(tmp);                                                           \
-        SetPF(tmp);                                                            \
+        SetLazyFlags(LF_INC | LF_WORD, wregs[reg], 1, tmp);                    \
         wregs[reg] = tmp;                                                      \
-        break;                                                                 \
+        NEXT_OP;                                                               \
     }
 
 #define DEC_WR(reg)                                                            \
     {                                                                          \
         uint16_t tmp = wregs[reg] - 1;                                         \
-        OF = tmp == 0x7FFF;                                                    \
-        AF = (tmp ^ (tmp + 1)) & 0x10;                                         \
-        SetZFW(tmp);                                                           \
-        SetSFW(tmp);                                                           \
-        SetPF(tmp);                                                            \
+        SetLazyFlags(LF_DEC | LF_WORD, wregs[reg], 1, tmp);                    \
         wregs[reg] = tmp;                                                      \
-        break;                                                                 \
+        NEXT_OP;                                                               \
     }
 
 static uint8_t FETCH_B(void)
@@ -387,7 +496,9 @@ static void SetModRMRMB(unsigned ModRM, uint8_t val)
         SetMemAbsB(ModRMAddress, val);
 }
 
-static void next_instruction(void)
+// Executes the instruction at CS:IP; with "chain" set, keeps running the
+// following ones until an event needs the outer loop (see NEXT_OP).
+static void next_instruction(int chain)
 {
     start_ip = ip;
     if(sregs[CS] == 0 && ip < 0x100) // Handle our BIOS codes
@@ -399,13 +510,22 @@ static void next_instruction(void)
             do_instruction(0xCF);
     }
     else
-        do_instruction(FETCH_B());
+        dispatch(FETCH_B(), chain);
 }
 
+// Set while "ip" points to a HLT waiting for an interrupt
+static int halted;
+
 void interrupt(unsigned int_num)
 {
     uint16_t dest_seg, dest_off;
 
+    if(halted)
+    {
+        ip++;
+        halted = 0;
+    }
+
     dest_off = GetMemAbsW(int_num * 4);
     dest_seg = GetMemAbsW(int_num * 4 + 2);
 
@@ -427,7 +547,7 @@ static void do_retf(void)
 
 static void trap_1(void)
 {
-    next_instruction();
+    next_instruction(0);
     interrupt(1);
 }
 
@@ -454,157 +574,81 @@ static void cpu_trap(int num)
 
 #define ADD_8()                                                                \
     unsigned tmp = dest + src;                                                 \
-    OF = (tmp ^ src) & (tmp ^ dest) & 0x80;                                    \
-    AF = (tmp ^ src ^ dest) & 0x10 ? 1 : 0;                                    \
-    CF = tmp >> 8;                                                             \
-    dest = tmp;                                                                \
-    SetZFB(dest);                                                              \
-    SetSFB(dest);                                                              \
-    SetPF(dest)
+    SetLazyFlags(LF_ADD | LF_BYTE, dest, src, tmp);                            \
+    dest = tmp
 
 #define ADD_16()                                                               \
     unsigned tmp = dest + src;                                                 \
-    OF = (tmp ^ src) & (tmp ^ dest) & 0x8000;                                  \
-    AF = (tmp ^ src ^ dest) & 0x10 ? 1 : 0;                                    \
-    CF = tmp >> 16;                                                            \
-    dest = tmp;                                                                \
-    SetZFW(dest);                                                              \
-    SetSFW(dest);                                                              \
-    SetPF(dest)
+    SetLazyFlags(LF_ADD | LF_WORD, dest, src, tmp);                            \
+    dest = tmp
 
 #define ADC_8()                                                                \
-    unsigned tmp = dest + src + CF;                                            \
-    OF = (tmp ^ src) & (tmp ^ dest) & 0x80;                                    \
-    AF = (tmp ^ src ^ dest) & 0x10 ? 1 : 0;                                    \
-    CF = tmp >> 8;                                                             \
-    dest = tmp;                                                                \
-    SetZFB(dest);                                                              \
-    SetSFB(dest);                                                              \
-    SetPF(dest);
+    unsigned tmp = dest + src + GetCF();                                       \
+    SetLazyFlags(LF_ADD | LF_BYTE, dest, src, tmp);                            \
+    dest = tmp;
 
 #define ADC_16()                                                               \
-    unsigned tmp = dest + src + CF;                                            \
-    OF = (tmp ^ src) & (tmp ^ dest) & 0x8000;                                  \
-    AF = (tmp ^ src ^ dest) & 0x10 ? 1 : 0;                                    \
-    CF = tmp >> 16;                                                            \
-    dest = tmp;                                                                \
-    SetZFW(dest);                                                              \
-    SetSFW(dest);                                                              \
-    SetPF(dest);
+    unsigned tmp = dest + src + GetCF();                                       \
+    SetLazyFlags(LF_ADD | LF_WORD, dest, src, tmp);                            \
+    dest = tmp;
 
 #define SBB_8()                                                                \
-    unsigned tmp = dest - src - CF;                                            \
-    CF = (tmp & 0x100) == 0x100;                                               \
-    OF = (dest ^ src) & (dest ^ tmp) & 0x80;                                   \
-    AF = (tmp ^ src ^ dest) & 0x10 ? 1 : 0;                                    \
-    dest = tmp;                                                                \
-    SetZFB(dest);                                                              \
-    SetSFB(dest);                                                              \
-    SetPF(dest);
+    unsigned tmp = dest - src - GetCF();                                       \
+    SetLazyFlags(LF_SUB | LF_BYTE, dest, src, tmp);                            \
+    dest = tmp;
 
 #define SBB_16()                                                               \
-    unsigned tmp = dest - src - CF;                                            \
-    CF = (tmp & 0x10000) == 0x10000;                                           \
-    OF = (dest ^ src) & (dest ^ tmp) & 0x8000;                                 \
-    AF = (tmp ^ src ^ dest) & 0x10 ? 1 : 0;                                    \
-    dest = tmp;                                                                \
-    SetZFW(dest);                                                              \
-    SetSFW(dest);                                                              \
-    SetPF(dest);
+    unsigned tmp = dest - src - GetCF();                                       \
+    SetLazyFlags(LF_SUB | LF_WORD, dest, src, tmp);                            \
+    dest = tmp;
 
 #define SUB_8()                                                                \
     unsigned tmp = dest - src;                                                 \
-    CF = (tmp & 0x100) == 0x100;                                               \
-    OF = (dest ^ src) & (dest ^ tmp) & 0x80;                                   \
-    AF = (tmp ^ src ^ dest) & 0x10 ? 1 : 0;                                    \
-    dest = tmp;                                                                \
-    SetZFB(dest);                                                              \
-    SetSFB(dest);                                                              \
-    SetPF(dest)
+    SetLazyFlags(LF_SUB | LF_BYTE, dest, src, tmp);                            \
+    dest = tmp
 
 #define SUB_16()                                                               \
     unsigned tmp = dest - src;                                                 \
-    CF = (tmp & 0x10000) == 0x10000;                                           \
-    OF = (dest ^ src) & (dest ^ tmp) & 0x8000;                                 \
-    AF = (tmp ^ src ^ dest) & 0x10 ? 1 : 0;                                    \
-    dest = tmp;                                                                \
-    SetZFW(dest);                                                              \
-    SetSFW(dest);                                                              \
-    SetPF(dest);
+    SetLazyFlags(LF_SUB | LF_WORD, dest, src, tmp);                            \
+    dest = tmp;
 
 #define CMP_8()                                                                \
-    uint16_t tmp = dest - src;                                                 \
-    CF = (tmp & 0x100) == 0x100;                                               \
-    OF = (dest ^ src) & (dest ^ tmp) & 0x80;                                   \
-    AF = (tmp ^ src ^ dest) & 0x10 ? 1 : 0;                                    \
-    SetZFB(tmp);                                                               \
-    SetSFB(tmp);                                                               \
-    SetPF(tmp);
+    SetLazyFlags(LF_SUB | LF_BYTE, dest, src, dest - src);
 
 #define CMP_16()                                                               \
-    unsigned tmp = dest - src;                                                 \
-    CF = (tmp & 0x10000) == 0x10000;                                           \
-    OF = (dest ^ src) & (dest ^ tmp) & 0x8000;                                 \
-    AF = (tmp ^ src ^ dest) & 0x10 ? 1 : 0;                                    \
-    SetZFW(tmp);                                                               \
-    SetSFW(tmp);                                                               \
-    SetPF(tmp);
+    SetLazyFlags(LF_SUB | LF_WORD, dest, src, dest - src);
 
 #define OR_8(op)                                                               \
     dest |= src;                                                               \
-    CF = OF = AF = 0;                                                          \
-    SetZFB(dest);                                                              \
-    SetSFB(dest);                                                              \
-    SetPF(dest);
+    SetLazyFlags(LF_LOG | LF_BYTE, dest, src, dest);
 
 #define OR_16(op)                                                              \
     dest |= src;                                                               \
-    CF = OF = AF = 0;                                                          \
-    SetZFW(dest);                                                              \
-    SetSFW(dest);                                                              \
-    SetPF(dest);
+    SetLazyFlags(LF_LOG | LF_WORD, dest, src, dest);
 
 #define AND_8(op)                                                              \
     dest &= src;                                                               \
-    CF = OF = AF = 0;                                                          \
-    SetZFB(dest);                                                              \
-    SetSFB(dest);                                                              \
-    SetPF(dest);
+    SetLazyFlags(LF_LOG | LF_BYTE, dest, src, dest);
 
 #define AND_16(op)                                                             \
     dest &= src;                                                               \
-    CF = OF = AF = 0;                                                          \
-    SetZFW(dest);                                                              \
-    SetSFW(dest);                                                              \
-    SetPF(dest);
+    SetLazyFlags(LF_LOG | LF_WORD, dest, src, dest);
 
 #define XOR_8(op)                                                              \
     dest ^= src;                                                               \
-    CF = OF = AF = 0;                                                          \
-    SetZFB(dest);                                                              \
-    SetSFB(dest);                                                              \
-    SetPF(dest);
+    SetLazyFlags(LF_LOG | LF_BYTE, dest, src, dest);
 
 #define XOR_16(op)                                                             \
     dest ^= src;                                                               \
-    CF = OF = AF = 0;                                                          \
-    SetZFW(dest);                                                              \
-    SetSFW(dest);                                                              \
-    SetPF(dest);
+    SetLazyFlags(LF_LOG | LF_WORD, dest, src, dest);
 
 #define TEST_8(op)                                                             \
     src &= dest;                                                               \
-    CF = OF = AF = 0;                                                          \
-    SetZFB(src);                                                               \
-    SetSFB(src);                                                               \
-    SetPF(src);
+    SetLazyFlags(LF_LOG | LF_BYTE, dest, src, src);
 
 #define TEST_16(op)                                                            \
     src &= dest;                                                               \
-    CF = OF = AF = 0;                                                          \
-    SetZFW(src);                                                               \
-    SetSFW(src);                                                               \
-    SetPF(src);
+    SetLazyFlags(LF_LOG | LF_WORD, dest, src, src);
 
 #define XCHG_8(op)                                                             \
     uint8_t tmp = dest;                                                        \
@@ -626,7 +670,15 @@ static void cpu_trap(int num)
         op##_8();                                                              \
         SET_br8();                                                             \
     }                                                                          \
-    break;
+    NEXT_OP;
+
+// CMP and TEST only read the memory operand
+#define OP_br8_rd(op)                                                          \
+    {                                                                          \
+        GET_br8();                                                             \
+        op##_8();                                                              \
+    }                                                                          \
+    NEXT_OP;
 
 #define OP_r8b(op)                                                             \
     {                                                                          \
@@ -634,7 +686,7 @@ static void cpu_trap(int num)
         op##_8();                                                              \
         SET_r8b();                                                             \
     }                                                                          \
-    break;
+    NEXT_OP;
 
 #define OP_wr16(op)                                                            \
     {                                                                          \
@@ -642,7 +694,14 @@ static void cpu_trap(int num)
         op##_16();                                                             \
         SET_wr16();                                                            \
     }                                                                          \
-    break;
+    NEXT_OP;
+
+#define OP_wr16_rd(op)                                                         \
+    {                                                                          \
+        GET_wr16();                                                            \
+        op##_16();                                                             \
+    }                                                                          \
+    NEXT_OP;
 
 #define OP_r16w(op)                                                            \
     {                                                                          \
@@ -650,7 +709,7 @@ static void cpu_trap(int num)
         op##_16();                                                             \
         SET_r16w();                                                            \
     }                                                                          \
-    break;
+    NEXT_OP;
 
 #define OP_ald8(op)                                                            \
     {                                                                          \
@@ -658,7 +717,7 @@ static void cpu_trap(int num)
         op##_8();                                                              \
         SET_ald8();                                                            \
     }                                                                          \
-    break;
+    NEXT_OP;
 
 #define OP_axd16(op)                                                           \
     {                                                                          \
@@ -666,17 +725,17 @@ static void cpu_trap(int num)
         op##_16();                                                             \
         SET_axd16();                                                           \
     }                                                                          \
-    break;
+    NEXT_OP;
 
 #define MOV_BRH(reg)                                                           \
     wregs[reg] = ((0x00FF & wregs[reg]) | (FETCH_B() << 8));                   \
-    break;
+    NEXT_OP;
 #define MOV_BRL(reg)                                                           \
     wregs[reg] = ((0xFF00 & wregs[reg]) | FETCH_B());                          \
-    break;
+    NEXT_OP;
 #define MOV_WRi(reg)                                                           \
     wregs[reg] = FETCH_W();                                                    \
-    break;
+    NEXT_OP;
 
 #define SEG_OVERRIDE(seg)                                                      \
     {                                                                          \
@@ -684,7 +743,7 @@ static void cpu_trap(int num)
         do_instruction(FETCH_B());                                             \
         segment_override = NoSeg;                                              \
     }                                                                          \
-    break;
+    NEXT_OP;
 
 static void i_undefined(void)
 {
@@ -694,6 +753,7 @@ static void i_undefined(void)
 
 static void i_das(void)
 {
+    SyncFlags();
     uint8_t old_al = wregs[AX] & 0xFF;
     uint8_t old_CF = CF;
     unsigned al = old_al;
@@ -720,6 +780,7 @@ static void i_das(void)
 
 static void i_daa(void)
 {
+    SyncFlags();
     uint8_t al = wregs[AX] & 0xFF;
     if(AF || ((al & 0xf) > 9))
     {
@@ -745,6 +806,7 @@ static void i_daa(void)
 
 static void i_aaa(void)
 {
+    SyncFlags();
     uint16_t ax = wregs[AX];
     if(AF || (ax & 0xF) > 9)
     {
@@ -766,6 +828,7 @@ static void i_aaa(void)
 
 static void i_aas(void)
 {
+    SyncFlags();
     uint16_t ax = wregs[AX];
     if(AF || (ax & 0xF) > 9)
     {
@@ -786,6 +849,7 @@ static void i_aas(void)
 }
 
 #define IMUL_2                                                                 \
+    SyncFlags();                                                               \
     uint32_t result = (int16_t)src * (int16_t)mult;                            \
     dest = result & 0xFFFF;                                                    \
     SetSFW(dest);                                                              \
@@ -810,11 +874,51 @@ static void i_imul_r16w_d8(void)
     SET_r16w();
 }
 
+/* A backward jump that arrives at the same CS:IP with the same registers
+   and flags, and without any memory write since the last time, is a loop
+   waiting for something external (the BIOS tick, an interrupt handler...),
+   so report it as an unsuccessful poll, unless the loop already polls
+   through a BIOS call or a port read.  */
+static struct
+{
+    uint16_t wregs[8];
+    uint16_t sregs[4];
+    uint16_t ip;
+    uint16_t flags; // 0xFFFF if not known
+    unsigned mem_changes;
+    unsigned polls;
+} spin;
+
+static void check_spin(void)
+{
+    if(spin.ip == ip && spin.mem_changes == idle_mem_changes &&
+       spin.polls == idle_polls && !memcmp(spin.wregs, wregs, sizeof(wregs)) &&
+       !memcmp(spin.sregs, sregs, sizeof(sregs)))
+    {
+        uint16_t flags = CompressFlags();
+        if(flags == spin.flags)
+            idle_poll();
+        spin.flags = flags;
+        spin.polls = idle_polls;
+        return;
+    }
+    memcpy(spin.wregs, wregs, sizeof(wregs));
+    memcpy(spin.sregs, sregs, sizeof(sregs));
+    spin.ip = ip;
+    spin.flags = 0xFFFF;
+    spin.mem_changes = idle_mem_changes;
+    spin.polls = idle_polls;
+}
+
 static void do_cjump(unsigned cond)
 {
     int8_t disp = FETCH_B();
     if(cond)
+    {
         ip = ip + disp;
+        if(disp < 0)
+            check_spin();
+    }
 }
 
 static void i_80pre(void)
@@ -1316,12 +1420,13 @@ static void i_int(void)
 
 static void i_into(void)
 {
-    if(OF)
+    if(GetOF())
         interrupt(4);
 }
 
 static uint8_t shift1_b(uint8_t val, int ModRM)
 {
+    SyncFlags();
     AF = 0;
     switch(ModRM & 0x38)
     {
@@ -1382,6 +1487,7 @@ static uint8_t shift1_b(uint8_t val, int ModRM)
 
 static uint8_t shifts_b(uint8_t val, int ModRM, unsigned count)
 {
+    SyncFlags();
 
 #ifdef CPU_SHIFT_80186
     count &= 0x1F;
@@ -1477,6 +1583,7 @@ static uint8_t shifts_b(uint8_t val, int ModRM, unsigned count)
 
 static uint16_t shift1_w(uint16_t val, int ModRM)
 {
+    SyncFlags();
     AF = 0;
     switch(ModRM & 0x38)
     {
@@ -1537,6 +1644,7 @@ static uint16_t shift1_w(uint16_t val, int ModRM)
 
 static uint16_t shifts_w(uint16_t val, int ModRM, unsigned count)
 {
+    SyncFlags();
 #ifdef CPU_SHIFT_80186
     count &= 0x1F;
 #endif
@@ -1694,6 +1802,7 @@ static void i_d3pre(void)
 
 static void i_aam(void)
 {
+    SyncFlags();
     unsigned mult = FETCH_B();
 
     if(mult == 0)
@@ -1711,6 +1820,7 @@ static void i_aam(void)
 
 static void i_aad(void)
 {
+    SyncFlags();
     unsigned mult = FETCH_B();
 
     uint16_t ax = wregs[AX];
@@ -1740,7 +1850,7 @@ static void i_loopne(void)
 {
     int disp = (int8_t)FETCH_B();
     wregs[CX]--;
-    if(!ZF && wregs[CX])
+    if(!GetZF() && wregs[CX])
         ip = ip + disp;
 }
 
@@ -1748,7 +1858,7 @@ static void i_loope(void)
 {
     int disp = (int8_t)FETCH_B();
     wregs[CX]--;
-    if(ZF && wregs[CX])
+    if(GetZF() && wregs[CX])
         ip = ip + disp;
 }
 
@@ -1819,6 +1929,8 @@ static void i_jmp_d8(void)
 {
     int8_t disp = FETCH_B();
     ip = ip + disp;
+    if(disp < 0)
+        check_spin();
 }
 
 static void i_inaldx(void)
@@ -1905,12 +2017,12 @@ static void rep(int flagval)
         wregs[CX] = count;
         break;
     case 0xa6: /* REP(N)E CMPSB */
-        for(ZF = flagval; (ZF == flagval) && (count > 0); count--)
+        for(SyncFlags(), ZF = flagval; (GetZF() == flagval) && (count > 0); count--)
             i_cmpsb();
         wregs[CX] = count;
         break;
     case 0xa7: /* REP(N)E CMPSW */
-        for(ZF = flagval; (ZF == flagval) && (count > 0); count--)
+        for(SyncFlags(), ZF = flagval; (GetZF() == flagval) && (count > 0); count--)
             i_cmpsw();
         wregs[CX] = count;
         break;
@@ -1935,12 +2047,12 @@ static void rep(int flagval)
         wregs[CX] = count;
         break;
     case 0xae: /* REP(N)E SCASB */
-        for(ZF = flagval; (ZF == flagval) && (count > 0); count--)
+        for(SyncFlags(), ZF = flagval; (GetZF() == flagval) && (count > 0); count--)
             i_scasb();
         wregs[CX] = count;
         break;
     case 0xaf: /* REP(N)E SCASW */
-        for(ZF = flagval; (ZF == flagval) && (count > 0); count--)
+        for(SyncFlags(), ZF = flagval; (GetZF() == flagval) && (count > 0); count--)
             i_scasw();
         wregs[CX] = count;
         break;
@@ -1959,28 +2071,21 @@ static void i_f6pre(void)
     case 0x00: /* TEST Eb, data8 */
     case 0x08: /* ??? */
         dest &= FETCH_B();
-        CF = OF = AF = 0;
-        SetZFB(dest);
-        SetSFB(dest);
-        SetPF(dest);
+        SetLazyFlags(LF_LOG | LF_BYTE, dest, dest, dest);
         break;
     case 0x10: /* NOT Eb */
         SetModRMRMB(ModRM, ~dest);
         break;
     case 0x18: /* NEG Eb */
+        SetLazyFlags(LF_SUB | LF_BYTE, 0, dest, 0 - dest);
         dest = 0x100 - dest;
-        CF = (dest != 0);
-        OF = (dest == 0x80);
-        AF = (dest ^ (0x100 - dest)) & 0x10;
-        SetZFB(dest);
-        SetSFB(dest);
-        SetPF(dest);
         SetModRMRMB(ModRM, dest);
         break;
     case 0x20: /* MUL AL, Eb */
     {
         uint16_t result = dest * (wregs[AX] & 0xFF);
 
+        SyncFlags();
         wregs[AX] = result;
         SetSFB(result);
         SetPF(result);
@@ -1992,6 +2097,7 @@ static void i_f6pre(void)
     {
         uint16_t result = (int8_t)dest * (int8_t)(wregs[AX] & 0xFF);
 
+        SyncFlags();
         wregs[AX] = result;
         SetSFB(result);
         SetPF(result);
@@ -2032,10 +2138,7 @@ static void i_f7pre(void)
     case 0x00: /* TEST Ew, data16 */
     case 0x08: /* ??? */
         dest &= FETCH_W();
-        CF = OF = AF = 0;
-        SetZFW(dest);
-        SetSFW(dest);
-        SetPF(dest);
+        SetLazyFlags(LF_LOG | LF_WORD, dest, dest, dest);
         break;
 
     case 0x10: /* NOT Ew */
@@ -2043,13 +2146,8 @@ static void i_f7pre(void)
         break;
 
     case 0x18: /* NEG Ew */
+        SetLazyFlags(LF_SUB | LF_WORD, 0, dest, 0 - dest);
         dest = 0x10000 - dest;
-        CF = (dest != 0);
-        OF = (dest == 0x8000);
-        AF = (dest ^ (0x10000 - dest)) & 0x10;
-        SetZFW(dest);
-        SetSFW(dest);
-        SetPF(dest);
         SetModRMRMW(ModRM, dest);
         break;
     case 0x20: /* MUL AX, Ew */
@@ -2059,6 +2157,7 @@ static void i_f7pre(void)
         wregs[AX] = result & 0xFFFF;
         wregs[DX] = result >> 16;
 
+        SyncFlags();
         SetSFW(result);
         SetPF(result);
         SetZFW(wregs[AX] | wregs[DX]);
@@ -2071,6 +2170,7 @@ static void i_f7pre(void)
         uint32_t result = (int16_t)dest * (int16_t)wregs[AX];
         wregs[AX] = result & 0xFFFF;
         wregs[DX] = result >> 16;
+        SyncFlags();
         SetSFW(result);
         SetPF(result);
         SetZFW(wregs[AX] | wregs[DX]);
@@ -2154,19 +2254,14 @@ static void i_fepre(void)
 
     if((ModRM & 0x38) == 0)
     {
+        SetLazyFlags(LF_INC | LF_BYTE, dest, 1, dest + 1);
         dest = dest + 1;
-        OF = (dest == 0x80);
-        AF = (dest ^ (dest - 1)) & 0x10;
     }
     else
     {
+        SetLazyFlags(LF_DEC | LF_BYTE, dest, 1, dest - 1);
         dest--;
-        OF = (dest == 0x7F);
-        AF = (dest ^ (dest + 1)) & 0x10;
     }
-    SetZFB(dest);
-    SetSFB(dest);
-    SetPF(dest);
     SetModRMRMB(ModRM, dest);
 }
 
@@ -2178,21 +2273,13 @@ static void i_ffpre(void)
     switch(ModRM & 0x38)
     {
     case 0x00: /* INC ew */
+        SetLazyFlags(LF_INC | LF_WORD, dest, 1, dest + 1);
         dest = dest + 1;
-        OF = (dest == 0x8000);
-        AF = (dest ^ (dest - 1)) & 0x10;
-        SetZFW(dest);
-        SetSFW(dest);
-        SetPF(dest);
         SetModRMRMW(ModRM, dest);
         break;
     case 0x08: /* DEC ew */
+        SetLazyFlags(LF_DEC | LF_WORD, dest, 1, dest - 1);
         dest = dest - 1;
-        OF = (dest == 0x7FFF);
-        AF = (dest ^ (dest + 1)) & 0x10;
-        SetZFW(dest);
-        SetSFW(dest);
-        SetPF(dest);
         SetModRMRMW(ModRM, dest);
         break;
     case 0x10: /* CALL ew */
@@ -2243,10 +2330,20 @@ static void i_leave(void)
     wregs[BP] = PopWord();
 }
 
-NORETURN static void i_halt(void)
+static void i_halt(void)
 {
-    printf("HALT instruction!\n");
-    exit(0);
+    // With interrupts disabled nothing can wake us up
+    if(!IF)
+    {
+        printf("HALT instruction!\n");
+        exit(0);
+    }
+    idle_halt();
+    // Only an interrupt ends the HLT: if none can be delivered, run the HLT
+    // again. The interrupt then returns after it, see interrupt().
+    halted = !pic_irq_unmasked();
+    if(halted)
+        ip--;
 }
 
 static void debug_instruction(void)
@@ -2258,285 +2355,330 @@ static void debug_instruction(void)
           cpuGetAX(), cpuGetBX(), cpuGetCX(), cpuGetDX(), cpuGetSP(), cpuGetBP(),
           cpuGetSI(), cpuGetDI());
     debug(debug_cpu, "DS=%04X ES=%04X SS=%04X CS=%04X IP=%04X %s %s %s %s %s %s %s %s ",
-          cpuGetDS(), cpuGetES(), cpuGetSS(), cpuGetCS(), nip, OF ? "OV" : "NV",
-          DF ? "DN" : "UP", IF ? "EI" : "DI", SF ? "NG" : "PL", ZF ? "ZR" : "NZ",
-          AF ? "AC" : "NA", PF ? "PE" : "PO", CF ? "CY" : "NC");
+          cpuGetDS(), cpuGetES(), cpuGetSS(), cpuGetCS(), nip, GetOF() ? "OV" : "NV",
+          DF ? "DN" : "UP", IF ? "EI" : "DI", GetSF() ? "NG" : "PL", GetZF() ? "ZR" : "NZ",
+          GetAF() ? "AC" : "NA", GetPF() ? "PE" : "PO", GetCF() ? "CY" : "NC");
     debug(debug_cpu, "%04X:%04X %s\n", sregs[CS], nip, disa(ip, nip, segment_override));
 }
 
-static void do_instruction(uint8_t code)
+/* Threaded dispatch: with GCC labels-as-values every opcode handler fetches
+   the next opcode and jumps straight to its handler, instead of returning to
+   execute() and going through the single switch jump.  The chain stops when
+   the timer asks to leave the CPU loop, when the instructions of the current
+   tick are exhausted, when an IRQ can be delivered, when execution enters our
+   BIOS code area or when not called with "chain".  */
+#if defined(__GNUC__) && !defined(NO_THREADED_DISPATCH)
+#define CASE(n)                                                                \
+    case n:                                                                    \
+        op_##n
+#define NEXT_OP                                                                \
+    if(chain && !exit_cpu && cpu_steps > 0 && !(IF && pic_irq_pending) &&      \
+       (sregs[CS] != 0 || ip >= 0x100))                                        \
+    {                                                                          \
+        cpu_steps--;                                                           \
+        start_ip = ip;                                                         \
+        goto *op_table[FETCH_B()];                                             \
+    }                                                                          \
+    break
+#define OP_ROW(h)                                                              \
+    &&op_0x##h##0, &&op_0x##h##1, &&op_0x##h##2, &&op_0x##h##3,                \
+    &&op_0x##h##4, &&op_0x##h##5, &&op_0x##h##6, &&op_0x##h##7,                \
+    &&op_0x##h##8, &&op_0x##h##9, &&op_0x##h##a, &&op_0x##h##b,                \
+    &&op_0x##h##c, &&op_0x##h##d, &&op_0x##h##e, &&op_0x##h##f
+#else
+#define CASE(n) case n
+#define NEXT_OP break
+#endif
+
+static void dispatch(uint8_t code, int chain)
 {
+#if defined(__GNUC__) && !defined(NO_THREADED_DISPATCH)
+    static const void *const op_table[256] = {
+        OP_ROW(0), OP_ROW(1), OP_ROW(2), OP_ROW(3), OP_ROW(4), OP_ROW(5),
+        OP_ROW(6), OP_ROW(7), OP_ROW(8), OP_ROW(9), OP_ROW(a), OP_ROW(b),
+        OP_ROW(c), OP_ROW(d), OP_ROW(e), OP_ROW(f)};
+#else
+    (void)chain;
+#endif
+
     if(debug_active(debug_cpu) && segment_override == NoSeg)
         debug_instruction();
     switch(code)
     {
-    case 0x00: OP_br8(ADD);
-    case 0x01: OP_wr16(ADD);
-    case 0x02: OP_r8b(ADD);
-    case 0x03: OP_r16w(ADD);
-    case 0x04: OP_ald8(ADD);
-    case 0x05: OP_axd16(ADD);
-    case 0x06: PushWord(sregs[ES]);                            break;
-    case 0x07: sregs[ES] = PopWord();                          break;
-    case 0x08: OP_br8(OR);
-    case 0x09: OP_wr16(OR);
-    case 0x0A: OP_r8b(OR);
-    case 0x0B: OP_r16w(OR);
-    case 0x0C: OP_ald8(OR);
-    case 0x0D: OP_axd16(OR);
-    case 0x0e: PushWord(sregs[CS]);                            break;
-    case 0x0f: i_undefined();                                  break;
-    case 0x10: OP_br8(ADC);
-    case 0x11: OP_wr16(ADC);
-    case 0x12: OP_r8b(ADC);
-    case 0x13: OP_r16w(ADC);
-    case 0x14: OP_ald8(ADC);
-    case 0x15: OP_axd16(ADC);
-    case 0x16: PushWord(sregs[SS]);                            break;
-    case 0x17: sregs[SS] = PopWord();                          break;
-    case 0x18: OP_br8(SBB);
-    case 0x19: OP_wr16(SBB);
-    case 0x1A: OP_r8b(SBB);
-    case 0x1B: OP_r16w(SBB);
-    case 0x1C: OP_ald8(SBB);
-    case 0x1D: OP_axd16(SBB);
-    case 0x1e: PushWord(sregs[DS]);                            break;
-    case 0x1f: sregs[DS] = PopWord();                          break;
-    case 0x20: OP_br8(AND);
-    case 0x21: OP_wr16(AND);
-    case 0x22: OP_r8b(AND);
-    case 0x23: OP_r16w(AND);
-    case 0x24: OP_ald8(AND);
-    case 0x25: OP_axd16(AND);
-    case 0x26: SEG_OVERRIDE(ES);
-    case 0x27: i_daa();                                        break;
-    case 0x28: OP_br8(SUB);
-    case 0x29: OP_wr16(SUB);
-    case 0x2A: OP_r8b(SUB);
-    case 0x2B: OP_r16w(SUB);
-    case 0x2C: OP_ald8(SUB);
-    case 0x2D: OP_axd16(SUB);
-    case 0x2E: SEG_OVERRIDE(CS);
-    case 0x2f: i_das();                                        break;
-    case 0x30: OP_br8(XOR);
-    case 0x31: OP_wr16(XOR);
-    case 0x32: OP_r8b(XOR);
-    case 0x33: OP_r16w(XOR);
-    case 0x34: OP_ald8(XOR);
-    case 0x35: OP_axd16(XOR);
-    case 0x36: SEG_OVERRIDE(SS);
-    case 0x37: i_aaa();                                        break;
-    case 0x38: OP_br8(CMP);
-    case 0x39: OP_wr16(CMP);
-    case 0x3A: OP_r8b(CMP);
-    case 0x3B: OP_r16w(CMP);
-    case 0x3C: OP_ald8(CMP);
-    case 0x3D: OP_axd16(CMP);
-    case 0x3E: SEG_OVERRIDE(DS);
-    case 0x3f: i_aas();                                        break;
-    case 0x40: INC_WR(AX);
-    case 0x41: INC_WR(CX);
-    case 0x42: INC_WR(DX);
-    case 0x43: INC_WR(BX);
-    case 0x44: INC_WR(SP);
-    case 0x45: INC_WR(BP);
-    case 0x46: INC_WR(SI);
-    case 0x47: INC_WR(DI);
-    case 0x48: DEC_WR(AX);
-    case 0x49: DEC_WR(CX);
-    case 0x4a: DEC_WR(DX);
-    case 0x4b: DEC_WR(BX);
-    case 0x4c: DEC_WR(SP);
-    case 0x4d: DEC_WR(BP);
-    case 0x4e: DEC_WR(SI);
-    case 0x4f: DEC_WR(DI);
-    case 0x50: PUSH_WR(AX);
-    case 0x51: PUSH_WR(CX);
-    case 0x52: PUSH_WR(DX);
-    case 0x53: PUSH_WR(BX);
-    case 0x54: PUSH_SP();
-    case 0x55: PUSH_WR(BP);
-    case 0x56: PUSH_WR(SI);
-    case 0x57: PUSH_WR(DI);
-    case 0x58: POP_WR(AX);
-    case 0x59: POP_WR(CX);
-    case 0x5a: POP_WR(DX);
-    case 0x5b: POP_WR(BX);
-    case 0x5c: POP_WR(SP);
-    case 0x5d: POP_WR(BP);
-    case 0x5e: POP_WR(SI);
-    case 0x5f: POP_WR(DI);
-    case 0x60: i_pusha();                                      break; /* 186 */
-    case 0x61: i_popa();                                       break; /* 186 */
-    case 0x62: i_bound();                                      break; /* 186 */
-    case 0x63: i_undefined();                                  break;
-    case 0x64: i_undefined();                                  break;
-    case 0x65: i_undefined();                                  break;
-    case 0x66: i_undefined();                                  break;
-    case 0x67: i_undefined();                                  break;
-    case 0x68: PushWord(FETCH_W());                            break; /* 186 */
-    case 0x69: i_imul_r16w_d16();                              break; /* 186 */
-    case 0x6a: PushWord((int8_t)FETCH_B());                    break; /* 186 */
-    case 0x6b: i_imul_r16w_d8();                               break; /* 186 */
-    case 0x6c: i_insb();                                       break; /* 186 */
-    case 0x6d: i_insw();                                       break; /* 186 */
-    case 0x6e: i_outsb();                                      break; /* 186 */
-    case 0x6f: i_outsw();                                      break; /* 186 */
-    case 0x70: do_cjump(OF);                                   break;
-    case 0x71: do_cjump(!OF);                                  break;
-    case 0x72: do_cjump(CF);                                   break;
-    case 0x73: do_cjump(!CF);                                  break;
-    case 0x74: do_cjump(ZF);                                   break;
-    case 0x75: do_cjump(!ZF);                                  break;
-    case 0x76: do_cjump(CF || ZF);                             break;
-    case 0x77: do_cjump(!CF && !ZF);                           break;
-    case 0x78: do_cjump(SF);                                   break;
-    case 0x79: do_cjump(!SF);                                  break;
-    case 0x7a: do_cjump(PF);                                   break;
-    case 0x7b: do_cjump(!PF);                                  break;
-    case 0x7c: do_cjump((!SF != !OF) && !ZF);                  break;
-    case 0x7d: do_cjump((!SF == !OF) || ZF);                   break;
-    case 0x7e: do_cjump((!SF != !OF) || ZF);                   break;
-    case 0x7f: do_cjump((!SF == !OF) && !ZF);                  break;
-    case 0x80: i_80pre();                                      break;
-    case 0x81: i_81pre();                                      break;
-    case 0x82: i_82pre();                                      break;
-    case 0x83: i_83pre();                                      break;
-    case 0x84: OP_br8(TEST);
-    case 0x85: OP_wr16(TEST);
-    case 0x86: i_xchg_br8();                                   break;
-    case 0x87: i_xchg_wr16();                                  break;
-    case 0x88: OP_br8(MOV);
-    case 0x89: OP_wr16(MOV);
-    case 0x8a: OP_r8b(MOV);
-    case 0x8b: OP_r16w(MOV);
-    case 0x8c: i_mov_wsreg();                                  break;
-    case 0x8d: i_lea();                                        break;
-    case 0x8e: i_mov_sregw();                                  break;
-    case 0x8f: i_popw();                                       break;
-    case 0x90: /* NOP */                                       break;
-    case 0x91: XCHG_AX_WR(CX);
-    case 0x92: XCHG_AX_WR(DX);
-    case 0x93: XCHG_AX_WR(BX);
-    case 0x94: XCHG_AX_WR(SP);
-    case 0x95: XCHG_AX_WR(BP);
-    case 0x96: XCHG_AX_WR(SI);
-    case 0x97: XCHG_AX_WR(DI);
-    case 0x98: wregs[AX] = (int8_t)(0xFF & wregs[AX]);         break;
-    case 0x99: wregs[DX] = (wregs[AX] & 0x8000) ? 0xffff : 0;  break;
-    case 0x9a: i_call_far();                                   break;
-    case 0x9b: /* WAIT */                                      break;
-    case 0x9c: PushWord(CompressFlags());                      break;
-    case 0x9d: do_popf();                                      break;
-    case 0x9e: i_sahf();                                       break;
-    case 0x9f: i_lahf();                                       break;
-    case 0xa0: i_mov_aldisp();                                 break;
-    case 0xa1: i_mov_axdisp();                                 break;
-    case 0xa2: i_mov_dispal();                                 break;
-    case 0xa3: i_mov_dispax();                                 break;
-    case 0xa4: i_movsb();                                      break;
-    case 0xa5: i_movsw();                                      break;
-    case 0xa6: i_cmpsb();                                      break;
-    case 0xa7: i_cmpsw();                                      break;
-    case 0xa8: OP_ald8(TEST);
-    case 0xa9: OP_axd16(TEST);
-    case 0xaa: i_stosb();                                      break;
-    case 0xab: i_stosw();                                      break;
-    case 0xac: i_lodsb();                                      break;
-    case 0xad: i_lodsw();                                      break;
-    case 0xae: i_scasb();                                      break;
-    case 0xaf: i_scasw();                                      break;
-    case 0xb0: MOV_BRL(AX);
-    case 0xb1: MOV_BRL(CX);
-    case 0xb2: MOV_BRL(DX);
-    case 0xb3: MOV_BRL(BX);
-    case 0xb4: MOV_BRH(AX);
-    case 0xb5: MOV_BRH(CX);
-    case 0xb6: MOV_BRH(DX);
-    case 0xb7: MOV_BRH(BX);
-    case 0xb8: MOV_WRi(AX);
-    case 0xb9: MOV_WRi(CX);
-    case 0xba: MOV_WRi(DX);
-    case 0xbb: MOV_WRi(BX);
-    case 0xbc: MOV_WRi(SP);
-    case 0xbd: MOV_WRi(BP);
-    case 0xbe: MOV_WRi(SI);
-    case 0xbf: MOV_WRi(DI);
-    case 0xc0: i_c0pre();                                      break; /* 186 */
-    case 0xc1: i_c1pre();                                      break; /* 186 */
-    case 0xc2: i_ret_d16();                                    break;
-    case 0xc3: i_ret();                                        break;
-    case 0xc4: i_les_dw();                                     break;
-    case 0xc5: i_lds_dw();                                     break;
-    case 0xc6: i_mov_bd8();                                    break;
-    case 0xc7: i_mov_wd16();                                   break;
-    case 0xc8: i_enter();                                      break;
-    case 0xc9: i_leave();                                      break;
-    case 0xca: i_retf_d16();                                   break;
-    case 0xcb: do_retf();                                      break;
-    case 0xcc: i_int3();                                       break;
-    case 0xcd: i_int();                                        break;
-    case 0xce: i_into();                                       break;
-    case 0xcf: do_iret();                                      break;
-    case 0xd0: i_d0pre();                                      break;
-    case 0xd1: i_d1pre();                                      break;
-    case 0xd2: i_d2pre();                                      break;
-    case 0xd3: i_d3pre();                                      break;
-    case 0xd4: i_aam();                                        break;
-    case 0xd5: i_aad();                                        break;
-    case 0xd6: i_undefined();                                  break;
-    case 0xd7: i_xlat();                                       break;
-    case 0xd8: i_escape();                                     break;
-    case 0xd9: i_escape();                                     break;
-    case 0xda: i_escape();                                     break;
-    case 0xdb: i_escape();                                     break;
-    case 0xdc: i_escape();                                     break;
-    case 0xdd: i_escape();                                     break;
-    case 0xde: i_escape();                                     break;
-    case 0xdf: i_escape();                                     break;
-    case 0xe0: i_loopne();                                     break;
-    case 0xe1: i_loope();                                      break;
-    case 0xe2: i_loop();                                       break;
-    case 0xe3: i_jcxz();                                       break;
-    case 0xe4: i_inal();                                       break;
-    case 0xe5: i_inax();                                       break;
-    case 0xe6: i_outal();                                      break;
-    case 0xe7: i_outax();                                      break;
-    case 0xe8: i_call_d16();                                   break;
-    case 0xe9: i_jmp_d16();                                    break;
-    case 0xea: i_jmp_far();                                    break;
-    case 0xeb: i_jmp_d8();                                     break;
-    case 0xec: i_inaldx();                                     break;
-    case 0xed: i_inaxdx();                                     break;
-    case 0xee: i_outdxal();                                    break;
-    case 0xef: i_outdxax();                                    break;
-    case 0xf0: /* LOCK */                                      break;
-    case 0xf1: i_undefined();                                  break;
-    case 0xf2: rep(0);                                         break;
-    case 0xf3: rep(1);                                         break;
-    case 0xf4: i_halt();
-    case 0xf5: CF = !CF;                                       break;
-    case 0xf6: i_f6pre();                                      break;
-    case 0xf7: i_f7pre();                                      break;
-    case 0xf8: CF = 0;                                         break;
-    case 0xf9: CF = 1;                                         break;
-    case 0xfa: IF = 0;                                         break;
-    case 0xfb: i_sti();                                        break;
-    case 0xfc: DF = 0;                                         break;
-    case 0xfd: DF = 1;                                         break;
-    case 0xfe: i_fepre();                                      break;
-    case 0xff: i_ffpre();                                      break;
+    CASE(0x00): OP_br8(ADD);
+    CASE(0x01): OP_wr16(ADD);
+    CASE(0x02): OP_r8b(ADD);
+    CASE(0x03): OP_r16w(ADD);
+    CASE(0x04): OP_ald8(ADD);
+    CASE(0x05): OP_axd16(ADD);
+    CASE(0x06): PushWord(sregs[ES]);                           NEXT_OP;
+    CASE(0x07): sregs[ES] = PopWord();                         NEXT_OP;
+    CASE(0x08): OP_br8(OR);
+    CASE(0x09): OP_wr16(OR);
+    CASE(0x0a): OP_r8b(OR);
+    CASE(0x0b): OP_r16w(OR);
+    CASE(0x0c): OP_ald8(OR);
+    CASE(0x0d): OP_axd16(OR);
+    CASE(0x0e): PushWord(sregs[CS]);                           NEXT_OP;
+    CASE(0x0f): i_undefined();                                 NEXT_OP;
+    CASE(0x10): OP_br8(ADC);
+    CASE(0x11): OP_wr16(ADC);
+    CASE(0x12): OP_r8b(ADC);
+    CASE(0x13): OP_r16w(ADC);
+    CASE(0x14): OP_ald8(ADC);
+    CASE(0x15): OP_axd16(ADC);
+    CASE(0x16): PushWord(sregs[SS]);                           NEXT_OP;
+    CASE(0x17): sregs[SS] = PopWord();                         NEXT_OP;
+    CASE(0x18): OP_br8(SBB);
+    CASE(0x19): OP_wr16(SBB);
+    CASE(0x1a): OP_r8b(SBB);
+    CASE(0x1b): OP_r16w(SBB);
+    CASE(0x1c): OP_ald8(SBB);
+    CASE(0x1d): OP_axd16(SBB);
+    CASE(0x1e): PushWord(sregs[DS]);                           NEXT_OP;
+    CASE(0x1f): sregs[DS] = PopWord();                         NEXT_OP;
+    CASE(0x20): OP_br8(AND);
+    CASE(0x21): OP_wr16(AND);
+    CASE(0x22): OP_r8b(AND);
+    CASE(0x23): OP_r16w(AND);
+    CASE(0x24): OP_ald8(AND);
+    CASE(0x25): OP_axd16(AND);
+    CASE(0x26): SEG_OVERRIDE(ES);
+    CASE(0x27): i_daa();                                       NEXT_OP;
+    CASE(0x28): OP_br8(SUB);
+    CASE(0x29): OP_wr16(SUB);
+    CASE(0x2a): OP_r8b(SUB);
+    CASE(0x2b): OP_r16w(SUB);
+    CASE(0x2c): OP_ald8(SUB);
+    CASE(0x2d): OP_axd16(SUB);
+    CASE(0x2e): SEG_OVERRIDE(CS);
+    CASE(0x2f): i_das();                                       NEXT_OP;
+    CASE(0x30): OP_br8(XOR);
+    CASE(0x31): OP_wr16(XOR);
+    CASE(0x32): OP_r8b(XOR);
+    CASE(0x33): OP_r16w(XOR);
+    CASE(0x34): OP_ald8(XOR);
+    CASE(0x35): OP_axd16(XOR);
+    CASE(0x36): SEG_OVERRIDE(SS);
+    CASE(0x37): i_aaa();                                       NEXT_OP;
+    CASE(0x38): OP_br8_rd(CMP);
+    CASE(0x39): OP_wr16_rd(CMP);
+    CASE(0x3a): OP_r8b(CMP);
+    CASE(0x3b): OP_r16w(CMP);
+    CASE(0x3c): OP_ald8(CMP);
+    CASE(0x3d): OP_axd16(CMP);
+    CASE(0x3e): SEG_OVERRIDE(DS);
+    CASE(0x3f): i_aas();                                       NEXT_OP;
+    CASE(0x40): INC_WR(AX);
+    CASE(0x41): INC_WR(CX);
+    CASE(0x42): INC_WR(DX);
+    CASE(0x43): INC_WR(BX);
+    CASE(0x44): INC_WR(SP);
+    CASE(0x45): INC_WR(BP);
+    CASE(0x46): INC_WR(SI);
+    CASE(0x47): INC_WR(DI);
+    CASE(0x48): DEC_WR(AX);
+    CASE(0x49): DEC_WR(CX);
+    CASE(0x4a): DEC_WR(DX);
+    CASE(0x4b): DEC_WR(BX);
+    CASE(0x4c): DEC_WR(SP);
+    CASE(0x4d): DEC_WR(BP);
+    CASE(0x4e): DEC_WR(SI);
+    CASE(0x4f): DEC_WR(DI);
+    CASE(0x50): PUSH_WR(AX);
+    CASE(0x51): PUSH_WR(CX);
+    CASE(0x52): PUSH_WR(DX);
+    CASE(0x53): PUSH_WR(BX);
+    CASE(0x54): PUSH_SP();
+    CASE(0x55): PUSH_WR(BP);
+    CASE(0x56): PUSH_WR(SI);
+    CASE(0x57): PUSH_WR(DI);
+    CASE(0x58): POP_WR(AX);
+    CASE(0x59): POP_WR(CX);
+    CASE(0x5a): POP_WR(DX);
+    CASE(0x5b): POP_WR(BX);
+    CASE(0x5c): POP_WR(SP);
+    CASE(0x5d): POP_WR(BP);
+    CASE(0x5e): POP_WR(SI);
+    CASE(0x5f): POP_WR(DI);
+    CASE(0x60): i_pusha();                                     NEXT_OP; /* 186 */
+    CASE(0x61): i_popa();                                      NEXT_OP; /* 186 */
+    CASE(0x62): i_bound();                                     NEXT_OP; /* 186 */
+    CASE(0x63): i_undefined();                                 NEXT_OP;
+    CASE(0x64): i_undefined();                                 NEXT_OP;
+    CASE(0x65): i_undefined();                                 NEXT_OP;
+    CASE(0x66): i_undefined();                                 NEXT_OP;
+    CASE(0x67): i_undefined();                                 NEXT_OP;
+    CASE(0x68): PushWord(FETCH_W());                           NEXT_OP; /* 186 */
+    CASE(0x69): i_imul_r16w_d16();                             NEXT_OP; /* 186 */
+    CASE(0x6a): PushWord((int8_t)FETCH_B());                   NEXT_OP; /* 186 */
+    CASE(0x6b): i_imul_r16w_d8();                              NEXT_OP; /* 186 */
+    CASE(0x6c): i_insb();                                      NEXT_OP; /* 186 */
+    CASE(0x6d): i_insw();                                      NEXT_OP; /* 186 */
+    CASE(0x6e): i_outsb();                                     NEXT_OP; /* 186 */
+    CASE(0x6f): i_outsw();                                     NEXT_OP; /* 186 */
+    CASE(0x70): do_cjump(GetOF());                             NEXT_OP;
+    CASE(0x71): do_cjump(!GetOF());                            NEXT_OP;
+    CASE(0x72): do_cjump(GetCF());                             NEXT_OP;
+    CASE(0x73): do_cjump(!GetCF());                            NEXT_OP;
+    CASE(0x74): do_cjump(GetZF());                             NEXT_OP;
+    CASE(0x75): do_cjump(!GetZF());                            NEXT_OP;
+    CASE(0x76): do_cjump(GetCF() || GetZF());                  NEXT_OP;
+    CASE(0x77): do_cjump(!GetCF() && !GetZF());                NEXT_OP;
+    CASE(0x78): do_cjump(GetSF());                             NEXT_OP;
+    CASE(0x79): do_cjump(!GetSF());                            NEXT_OP;
+    CASE(0x7a): do_cjump(GetPF());                             NEXT_OP;
+    CASE(0x7b): do_cjump(!GetPF());                            NEXT_OP;
+    CASE(0x7c): do_cjump((!GetSF() != !GetOF()) && !GetZF());  NEXT_OP;
+    CASE(0x7d): do_cjump((!GetSF() == !GetOF()) || GetZF());   NEXT_OP;
+    CASE(0x7e): do_cjump((!GetSF() != !GetOF()) || GetZF());   NEXT_OP;
+    CASE(0x7f): do_cjump((!GetSF() == !GetOF()) && !GetZF());  NEXT_OP;
+    CASE(0x80): i_80pre();                                     NEXT_OP;
+    CASE(0x81): i_81pre();                                     NEXT_OP;
+    CASE(0x82): i_82pre();                                     NEXT_OP;
+    CASE(0x83): i_83pre();                                     NEXT_OP;
+    CASE(0x84): OP_br8_rd(TEST);
+    CASE(0x85): OP_wr16_rd(TEST);
+    CASE(0x86): i_xchg_br8();                                  NEXT_OP;
+    CASE(0x87): i_xchg_wr16();                                 NEXT_OP;
+    CASE(0x88): OP_br8(MOV);
+    CASE(0x89): OP_wr16(MOV);
+    CASE(0x8a): OP_r8b(MOV);
+    CASE(0x8b): OP_r16w(MOV);
+    CASE(0x8c): i_mov_wsreg();                                 NEXT_OP;
+    CASE(0x8d): i_lea();                                       NEXT_OP;
+    CASE(0x8e): i_mov_sregw();                                 NEXT_OP;
+    CASE(0x8f): i_popw();                                      NEXT_OP;
+    CASE(0x90): /* NOP */                                      NEXT_OP;
+    CASE(0x91): XCHG_AX_WR(CX);
+    CASE(0x92): XCHG_AX_WR(DX);
+    CASE(0x93): XCHG_AX_WR(BX);
+    CASE(0x94): XCHG_AX_WR(SP);
+    CASE(0x95): XCHG_AX_WR(BP);
+    CASE(0x96): XCHG_AX_WR(SI);
+    CASE(0x97): XCHG_AX_WR(DI);
+    CASE(0x98): wregs[AX] = (int8_t)(0xFF & wregs[AX]);        NEXT_OP;
+    CASE(0x99): wregs[DX] = (wregs[AX] & 0x8000) ? 0xffff : 0; NEXT_OP;
+    CASE(0x9a): i_call_far();                                  NEXT_OP;
+    CASE(0x9b): /* WAIT */                                     NEXT_OP;
+    CASE(0x9c): PushWord(CompressFlags());                     NEXT_OP;
+    CASE(0x9d): do_popf();                                     NEXT_OP;
+    CASE(0x9e): i_sahf();                                      NEXT_OP;
+    CASE(0x9f): i_lahf();                                      NEXT_OP;
+    CASE(0xa0): i_mov_aldisp();                                NEXT_OP;
+    CASE(0xa1): i_mov_axdisp();                                NEXT_OP;
+    CASE(0xa2): i_mov_dispal();                                NEXT_OP;
+    CASE(0xa3): i_mov_dispax();                                NEXT_OP;
+    CASE(0xa4): i_movsb();                                     NEXT_OP;
+    CASE(0xa5): i_movsw();                                     NEXT_OP;
+    CASE(0xa6): i_cmpsb();                                     NEXT_OP;
+    CASE(0xa7): i_cmpsw();                                     NEXT_OP;
+    CASE(0xa8): OP_ald8(TEST);
+    CASE(0xa9): OP_axd16(TEST);
+    CASE(0xaa): i_stosb();                                     NEXT_OP;
+    CASE(0xab): i_stosw();                                     NEXT_OP;
+    CASE(0xac): i_lodsb();                                     NEXT_OP;
+    CASE(0xad): i_lodsw();                                     NEXT_OP;
+    CASE(0xae): i_scasb();                                     NEXT_OP;
+    CASE(0xaf): i_scasw();                                     NEXT_OP;
+    CASE(0xb0): MOV_BRL(AX);
+    CASE(0xb1): MOV_BRL(CX);
+    CASE(0xb2): MOV_BRL(DX);
+    CASE(0xb3): MOV_BRL(BX);
+    CASE(0xb4): MOV_BRH(AX);
+    CASE(0xb5): MOV_BRH(CX);
+    CASE(0xb6): MOV_BRH(DX);
+    CASE(0xb7): MOV_BRH(BX);
+    CASE(0xb8): MOV_WRi(AX);
+    CASE(0xb9): MOV_WRi(CX);
+    CASE(0xba): MOV_WRi(DX);
+    CASE(0xbb): MOV_WRi(BX);
+    CASE(0xbc): MOV_WRi(SP);
+    CASE(0xbd): MOV_WRi(BP);
+    CASE(0xbe): MOV_WRi(SI);
+    CASE(0xbf): MOV_WRi(DI);
+    CASE(0xc0): i_c0pre();                                     NEXT_OP; /* 186 */
+    CASE(0xc1): i_c1pre();                                     NEXT_OP; /* 186 */
+    CASE(0xc2): i_ret_d16();                                   NEXT_OP;
+    CASE(0xc3): i_ret();                                       NEXT_OP;
+    CASE(0xc4): i_les_dw();                                    NEXT_OP;
+    CASE(0xc5): i_lds_dw();                                    NEXT_OP;
+    CASE(0xc6): i_mov_bd8();                                   NEXT_OP;
+    CASE(0xc7): i_mov_wd16();                                  NEXT_OP;
+    CASE(0xc8): i_enter();                                     NEXT_OP;
+    CASE(0xc9): i_leave();                                     NEXT_OP;
+    CASE(0xca): i_retf_d16();                                  NEXT_OP;
+    CASE(0xcb): do_retf();                                     NEXT_OP;
+    CASE(0xcc): i_int3();                                      NEXT_OP;
+    CASE(0xcd): i_int();                                       NEXT_OP;
+    CASE(0xce): i_into();                                      NEXT_OP;
+    CASE(0xcf): do_iret();                                     NEXT_OP;
+    CASE(0xd0): i_d0pre();                                     NEXT_OP;
+    CASE(0xd1): i_d1pre();                                     NEXT_OP;
+    CASE(0xd2): i_d2pre();                                     NEXT_OP;
+    CASE(0xd3): i_d3pre();                                     NEXT_OP;
+    CASE(0xd4): i_aam();                                       NEXT_OP;
+    CASE(0xd5): i_aad();                                       NEXT_OP;
+    CASE(0xd6): i_undefined();                                 NEXT_OP;
+    CASE(0xd7): i_xlat();                                      NEXT_OP;
+    CASE(0xd8): i_escape();                                    NEXT_OP;
+    CASE(0xd9): i_escape();                                    NEXT_OP;
+    CASE(0xda): i_escape();                                    NEXT_OP;
+    CASE(0xdb): i_escape();                                    NEXT_OP;
+    CASE(0xdc): i_escape();                                    NEXT_OP;
+    CASE(0xdd): i_escape();                                    NEXT_OP;
+    CASE(0xde): i_escape();                                    NEXT_OP;
+    CASE(0xdf): i_escape();                                    NEXT_OP;
+    CASE(0xe0): i_loopne();                                    NEXT_OP;
+    CASE(0xe1): i_loope();                                     NEXT_OP;
+    CASE(0xe2): i_loop();                                      NEXT_OP;
+    CASE(0xe3): i_jcxz();                                      NEXT_OP;
+    CASE(0xe4): i_inal();                                      NEXT_OP;
+    CASE(0xe5): i_inax();                                      NEXT_OP;
+    CASE(0xe6): i_outal();                                     NEXT_OP;
+    CASE(0xe7): i_outax();                                     NEXT_OP;
+    CASE(0xe8): i_call_d16();                                  NEXT_OP;
+    CASE(0xe9): i_jmp_d16();                                   NEXT_OP;
+    CASE(0xea): i_jmp_far();                                   NEXT_OP;
+    CASE(0xeb): i_jmp_d8();                                    NEXT_OP;
+    CASE(0xec): i_inaldx();                                    NEXT_OP;
+    CASE(0xed): i_inaxdx();                                    NEXT_OP;
+    CASE(0xee): i_outdxal();                                   NEXT_OP;
+    CASE(0xef): i_outdxax();                                   NEXT_OP;
+    CASE(0xf0): /* LOCK */                                     NEXT_OP;
+    CASE(0xf1): i_undefined();                                 NEXT_OP;
+    CASE(0xf2): rep(0);                                        NEXT_OP;
+    CASE(0xf3): rep(1);                                        NEXT_OP;
+    CASE(0xf4): i_halt();                                      NEXT_OP;
+    CASE(0xf5): SyncFlags(); CF = !CF;                         NEXT_OP;
+    CASE(0xf6): i_f6pre();                                     NEXT_OP;
+    CASE(0xf7): i_f7pre();                                     NEXT_OP;
+    CASE(0xf8): SyncFlags(); CF = 0;                           NEXT_OP;
+    CASE(0xf9): SyncFlags(); CF = 1;                           NEXT_OP;
+    CASE(0xfa): IF = 0;                                        NEXT_OP;
+    CASE(0xfb): i_sti();                                       NEXT_OP;
+    CASE(0xfc): DF = 0;                                        NEXT_OP;
+    CASE(0xfd): DF = 1;                                        NEXT_OP;
+    CASE(0xfe): i_fepre();                                     NEXT_OP;
+    CASE(0xff): i_ffpre();                                     NEXT_OP;
     };
 }
 
-extern void handle_irq(void);
+static void do_instruction(uint8_t code)
+{
+    dispatch(code, 0);
+}
+
 void execute(void)
 {
-    for(; !exit_cpu;)
+    // The trace needs to see every instruction, so don't chain them.
+    int chain = !debug_active(debug_cpu);
+    for(; !exit_cpu && cpu_steps > 0;)
     {
-        if(IF)
+        if(IF && pic_irq_pending)
             handle_irq();
-        next_instruction();
+        cpu_steps--;
+        next_instruction(chain);
     }
 }
 
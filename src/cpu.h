@@ -48,8 +48,9 @@ enum
 #define SetSFB(x) (SF = (x)&0x80)
 
 #define CompressFlags()                                                                  \
-    (uint16_t)(CF | 2 | (PF << 2) | (!(!AF) << 4) | (ZF << 6) | (!(!SF) << 7) |          \
-               (TF << 8) | (IF << 9) | (DF << 10) | (!(!OF) << 11))
+    (SyncFlags(),                                                                        \
+     (uint16_t)(CF | 2 | (PF << 2) | (!(!AF) << 4) | (ZF << 6) | (!(!SF) << 7) |         \
+                (TF << 8) | (IF << 9) | (DF << 10) | (!(!OF) << 11)))
 
 #define ExpandFlags(f)                                                                   \
     {                                                                                    \
@@ -62,4 +63,5 @@ enum
         IF = ((f)&512) == 512;                                                           \
         DF = ((f)&1024) == 1024;                                                         \
         OF = (f)&2048;                                                                   \
+        lf_op = LF_NONE;                                                                 \
     }
@@ -63,14 +63,19 @@ NORETURN void print_usage(void)
            "  %-18s  Use LIM-EMS 4.0. Set this variable as available pages.\n"
 #endif
            "  %-18s  Filename mode (7bit, 8bit or DBCS).\n"
-           "  %-18s  Exec child process in same emulator process.\n",
+           "  %-18s  Exec child process in same emulator process.\n"
+           "  %-18s  Don't sleep while the program busy-waits for input.\n"
+           "  %-18s  File with keys to type before reading the terminal.\n"
+           "  %-18s  Virtual clock, advances each given number of instructions\n"
+           "                      per timer tick (default 100000) or when idle.\n"
+           "  %-18s  Reproducible runs: virtual clock starting at 1990-01-01.\n",
            prog_name, ENV_DBG_NAME, ENV_DBG_OPT, ENV_PROGNAME, ENV_DEF_DRIVE, ENV_CWD,
            ENV_DRIVE "n", ENV_CODEPAGE, ENV_LOWMEM, ENV_MEMFLAG, ENV_LOWMEM, ENV_APPEND,
            ENV_DOSVER, ENV_WINVER, ENV_ROWS, ENV_MEMSIZE,
 #ifdef EMS_SUPPORT
            ENV_EMSMEM,
 #endif
-           ENV_FILENAME, ENV_EXEC_SAME);
+           ENV_FILENAME, ENV_EXEC_SAME, ENV_NOIDLE, ENV_KEYS, ENV_TURBO, ENV_DETERM);
     exit(EXIT_SUCCESS);
 }
 
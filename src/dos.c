@@ -6,6 +6,7 @@
 #include "emu.h"
 #include "env.h"
 #include "extmem.h"
+#include "idle.h"
 #include "keyb.h"
 #include "loader.h"
 #include "os.h"
@@ -743,7 +744,8 @@ static int get_attributes(mode_t md)
     return r;
 }
 
-static void update_dos_sft(int sidx, const struct stat *st)
+// Writes the SFT record of "sidx" to guest memory.
+static void write_dos_sft(int sidx, const struct stat *st)
 {
     int dos_major = dosver & 0x0f;
     int dos_minor = (dosver >> 8) & 0xff;
@@ -751,8 +753,6 @@ static void update_dos_sft(int sidx, const struct stat *st)
     int attr, drive, name, size, timedate, start, len;
 
     assert(sidx >= 0 && sidx <= max_handles);
-    if((filetable[sidx].devinfo & 0xffe0) != 0) // check regular file or not
-        return;
     debug(debug_dos, "\t\tupdate dos system file table %d\n", sidx);
 
     switch(dos_major)
@@ -794,7 +794,9 @@ static void update_dos_sft(int sidx, const struct stat *st)
     }
 
     memset(buf, 0, sizeof(buf));
-    if(filetable[sidx].count && filetable[sidx].f != 0)
+    // Devices are not listed, their records stay cleared
+    if((filetable[sidx].devinfo & 0xffe0) == 0 && filetable[sidx].count &&
+       filetable[sidx].f != 0)
     {
         struct stat _st;
         if(st == NULL)
@@ -851,6 +853,36 @@ static void update_dos_sft(int sidx, const struct stat *st)
 #endif
 }
 
+// The SFT is only reachable through the SYSVARS pointer, so the records are
+// written when a program asks for it and kept current from then on.
+static int sft_visible = 0;
+static uint8_t sft_dirty[max_handles + 1];
+
+static void flush_dos_sft(void)
+{
+    for(int i = 0; i <= max_handles; i++)
+    {
+        if(sft_dirty[i])
+        {
+            sft_dirty[i] = 0;
+            write_dos_sft(i, NULL);
+        }
+    }
+    sft_visible = 1;
+}
+
+static void update_dos_sft(int sidx, const struct stat *st)
+{
+    if(sft_visible)
+    {
+        // Keep the old behaviour of not touching device records
+        if((filetable[sidx].devinfo & 0xffe0) == 0)
+            write_dos_sft(sidx, st);
+    }
+    else
+        sft_dirty[sidx] = 1;
+}
+
 // DOS int 21, ah=43
 static void intr21_43(int lfn)
 {
@@ -1020,7 +1052,7 @@ static void dos_find_next(int first)
         {
             // Fills volume label data
             put8(dosDTA + 0x15, 8);
-            put32(dosDTA + 0x16, get_time_date(time(0)));
+            put32(dosDTA + 0x16, get_time_date(timer_time()));
             put32(dosDTA + 0x1A, 0);
         }
         // Fills dos file name
@@ -1104,7 +1136,7 @@ static void dos_find_next_fcb(void)
         else
         {
             put8(ofcb + 0x0C, 8);
-            put32(ofcb + 0x17, get_time_date(time(0)));
+            put32(ofcb + 0x17, get_time_date(timer_time()));
             put32(ofcb + 0x1D, 0);
         }
         if(exfcb)
@@ -1192,65 +1224,132 @@ static void dos_get_drive_info(uint8_t drive)
     cpuClrFlag(cpuFlag_CF);
 }
 
-static void fputc_unicode(uint8_t ch, FILE *fd)
+// Converts a string to UTF-8 and writes it with one call, the output is
+// flushed by the stdio buffering, on input requests and on each timer tick.
+static void fputs_unicode(const uint8_t *str, unsigned len, FILE *fd)
 {
     static int in_dbcs = 0;
-    if(ch < 0x20)
-        in_dbcs = 0;
-    if(!in_dbcs && ch < 0x80)
-        fputc(ch, fd);
-    else
+    uint8_t buf[512 + 4];
+    uint8_t *p = buf;
+
+    for(unsigned i = 0; i < len; i++)
     {
-        uint16_t uc = get_unicode(ch, NULL);
-        uint8_t buf[5];
-        uint8_t *p = buf;
-        if(uc == 0)
+        if(!in_dbcs)
         {
-            in_dbcs = 1;
-            return;
+            // Copy runs of ASCII characters directly
+            unsigned n = ascii_span(str + i, len - i);
+            while(n)
+            {
+                unsigned l = 512 - (p - buf);
+                if(l > n)
+                    l = n;
+                memcpy(p, str + i, l);
+                p += l;
+                i += l;
+                n -= l;
+                if(p - buf >= 512)
+                {
+                    fwrite(buf, 1, p - buf, fd);
+                    p = buf;
+                }
+            }
+            if(i == len)
+                break;
+        }
+        uint8_t ch = str[i];
+        if(ch < 0x20)
+            in_dbcs = 0;
+        if(!in_dbcs && ch < 0x80)
+            *p++ = ch;
+        else
+        {
+            uint16_t uc = get_unicode(ch, NULL);
+            if(uc == 0)
+            {
+                in_dbcs = 1;
+                continue;
+            }
+            unicode_to_utf8(&p, uc);
+            in_dbcs = 0;
+        }
+        if(p - buf >= 512)
+        {
+            fwrite(buf, 1, p - buf, fd);
+            p = buf;
         }
-        unicode_to_utf8(&p, uc);
-        *p = '\0';
-        fputs((char *)buf, fd);
-        fflush(fd);
-        in_dbcs = 0;
     }
+    if(p != buf)
+        fwrite(buf, 1, p - buf, fd);
+    // Only the standard output is flushed on each timer tick
+    if(fd != stdout)
+        fflush(fd);
 }
 
-// Writes a character to standard output.
-static void dos_putchar(uint8_t ch, int sidx)
+// Writes a string to a DOS handle, with console character conversion.
+static void dos_write(const uint8_t *str, unsigned len, int sidx)
 {
+    // Input scripts can wait for text written to the standard handles,
+    // even if redirected, or to character devices
+    if(!video_active() &&
+       (sidx <= 2 || (filetable[sidx].devinfo & 0x80) || !filetable[sidx].f))
+        keyb_console_output(str, len);
     if(filetable[sidx].devinfo == 0x80D3 && video_active())
     {
-        // Handle TAB character here:
-        if(ch == 0x09)
+        for(unsigned i = 0; i < len; i++)
         {
-            int n = 8 - (7 & video_get_col());
-            while(n--)
-                video_putch(' ');
+            // Handle TAB character here:
+            if(str[i] == 0x09)
+            {
+                int n = 8 - (7 & video_get_col());
+                while(n--)
+                    video_putch(' ');
+            }
+            else
+                video_putch(str[i]);
         }
-        else
-            video_putch(ch);
     }
     else if(filetable[sidx].devinfo == 0x80D3)
-        fputc_unicode(ch, filetable[sidx].f);
+        fputs_unicode(str, len, filetable[sidx].f);
     else if(!filetable[sidx].f)
-        fputc_unicode(ch, stdout);
+        fputs_unicode(str, len, stdout);
     else if(!sidx && filetable[0].devinfo == 0x80D3 && filetable[1].devinfo == 0x80D3)
         // DOS programs can write to STDIN and expect output to the terminal.
         // This hack will only work if STDOUT is not redirected, in real DOS
         // you can redirect STDOUT and write to STDIN.
-        fputc_unicode(ch, filetable[1].f);
+        fputs_unicode(str, len, filetable[1].f);
     else
-        fputc(ch, filetable[sidx].f);
+        fwrite(str, 1, len, filetable[sidx].f);
+}
+
+// Writes a character to standard output.
+static void dos_putchar(uint8_t ch, int sidx)
+{
+    dos_write(&ch, 1, sidx);
+}
+
+// Sends pending console output to the terminal, used before waiting for input
+static void con_flush(void)
+{
+    check_screen();
+    fflush(filetable[1].f ? filetable[1].f : stdout);
 }
 
 static void intr21_9(void)
 {
     int i = cpuGetAddrDS(cpuGetDX());
+    uint8_t buf[256];
+    unsigned len = 0;
 
     for(; get8(i) != 0x24 && i < 0x100000; i++)
-        dos_putchar(get8(i), 1);
+    {
+        buf[len++] = get8(i);
+        if(len == sizeof(buf))
+        {
+            dos_write(buf, len, 1);
+            len = 0;
+        }
+    }
+    dos_write(buf, len, 1);
 
     dos_error = 0;
     cpuSetAL(0x24);
@@ -1260,6 +1359,8 @@ static unsigned return_code;
 // Runs the emulator again with given parameters
 static int run_emulator(char *file, const char *prgname, char *cmdline, char *env)
 {
+    // Don't let the child output overtake ours
+    con_flush();
     pid_t pid = fork();
     if(pid == -1)
         print_error("fork error, %s\n", strerror(errno));
@@ -1349,7 +1450,7 @@ NORETURN void intr20(void)
 static uint16_t inp_last_key;
 static void char_input(int brk)
 {
-    fflush(filetable[1].f ? filetable[1].f : stdout);
+    con_flush();
 
     if(inp_last_key == 0)
     {
@@ -1370,11 +1471,15 @@ static void char_input(int brk)
 // Returns true if a character to read is pending
 static int char_pending(void)
 {
-    return (inp_last_key != 0) || kbhit();
+    if((inp_last_key != 0) || kbhit())
+        return 1;
+    idle_poll();
+    return 0;
 }
 
 static int line_input(FILE *f, uint8_t *buf, int max)
 {
+    con_flush();
     if(video_active())
     {
         static int last_key = 0;
@@ -2388,12 +2493,10 @@ int intr21(void)
     case 1: // CHARACTER INPUT WITH ECHO
         char_input(1);
         dos_putchar(cpuGetAX() & 0xFF, 1);
-        check_screen();
         update_dos_sft(0, NULL);
         break;
     case 2: // PUTCH
         dos_putchar(cpuGetDX() & 0xFF, 1);
-        check_screen();
         update_dos_sft(1, NULL);
         cpuSetAX(0x0200 | (cpuGetDX() & 0xFF)); // from intlist.
         break;
@@ -2415,7 +2518,7 @@ int intr21(void)
         {
             // Wake-up keyboard on character output. This is needed so that
             // VEDIT writes faster to the screen, see issue #71
-            keyb_wakeup();
+            idle_activity();
             dos_putchar(cpuGetDX() & 0xFF, 1);
             cpuSetAL(cpuGetDX());
         }
@@ -2431,7 +2534,6 @@ int intr21(void)
         break;
     case 0x9: // WRITE STRING
         intr21_9();
-        check_screen();
         update_dos_sft(1, NULL);
         break;
     case 0xA: // BUFFERED INPUT
@@ -2795,7 +2897,7 @@ int intr21(void)
     }
     case 0x2A: // GET SYSTEM DATE
     {
-        time_t tm = time(0);
+        time_t tm = timer_time();
         struct tm lt;
         if(localtime_r(&tm, &lt))
         {
@@ -3066,9 +3168,7 @@ int intr21(void)
         }
         if(filetable[sidx].devinfo == 0x80D3)
         {
-            for(unsigned i = 0; i < len; i++)
-                dos_putchar(buf[i], sidx);
-            check_screen();
+            dos_write(buf, len, sidx);
             cpuSetAX(len);
         }
         else
@@ -3366,6 +3466,8 @@ int intr21(void)
                 dos_error = 0;
                 cpuClrFlag(cpuFlag_CF);
             }
+            if(f)
+                fclose(f);
         }
         else if(!getenv(ENV_EXEC_SAME) && (ax & 0xFF) == 0)
         {
@@ -3662,6 +3764,7 @@ int intr21(void)
         cpuSetBX(get_current_PSP());
         break;
     case 0x52: // GET SYSVARS
+        flush_dos_sft();
         cpuSetES(dos_sysvars >> 4);
         cpuSetBX((dos_sysvars & 0xF) + 24);
         break;
@@ -4196,6 +4299,22 @@ void install_dummy_handler(int inum)
     put16(inum * 4 + 2, (hndl >> 4) & 0xFFFF);
 }
 
+BIOS_IRET(intr20)
+BIOS_IRET(intr22)
+BIOS_IRET(intr28)
+BIOS_IRET(intr29)
+BIOS_IRET(intr2f)
+
+void init_dos_routines(void)
+{
+    reg_bios_routine(0x20, intr20_iret);
+    reg_bios_routine(0x21, intr21);
+    reg_bios_routine(0x22, intr22_iret);
+    reg_bios_routine(0x28, intr28_iret);
+    reg_bios_routine(0x29, intr29_iret);
+    reg_bios_routine(0x2F, intr2f_iret);
+}
+
 void init_dos(int argc, char **argv)
 {
     char args[256], environ[4096];
@@ -4203,6 +4322,7 @@ void init_dos(int argc, char **argv)
     memset(args, 0, 256);
     memset(environ, 0, sizeof(environ));
 
+    init_dos_routines();
     init_handles();
     init_codepage();
     init_nls_data();
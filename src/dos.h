@@ -6,6 +6,8 @@
 #include <stdio.h>
 
 void init_dos(int argc, char **argv);
+// Registers the DOS interrupt handlers, called from init_dos().
+void init_dos_routines(void);
 NORETURN void intr20(void);
 int intr21(void);
 void intr2f(void);
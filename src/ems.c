@@ -3,6 +3,7 @@
 #include "emu.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef EMS_SUPPORT
 
@@ -168,24 +169,154 @@ void ems_put8(int addr, int value)
     }
 }
 
-/* XXX This function may be slow, so fix in the future */
+// Returns a pointer to conventional memory at "addr", with the EMS page frame
+// mapped, and reduces "*len" to the bytes that are contiguous from there.
+// Returns NULL for an unmapped page of the page frame.
+static uint8_t *conv_span(uint32_t addr, unsigned *len)
+{
+    if(!use_ems || addr >= EMS_ADDR_END)
+        return memory + addr;
+    if(addr < EMS_ADDR_BEGIN)
+    {
+        if(*len > EMS_ADDR_BEGIN - addr)
+            *len = EMS_ADDR_BEGIN - addr;
+        return memory + addr;
+    }
+    unsigned pg = (addr - EMS_ADDR_BEGIN) / EMS_PAGESIZE;
+    unsigned off = (addr - EMS_ADDR_BEGIN) % EMS_PAGESIZE;
+    if(*len > EMS_PAGESIZE - off)
+        *len = EMS_PAGESIZE - off;
+    if(ems_map.ems_data[pg] == NULL)
+        return NULL;
+    return ems_map.ems_data[pg]->memory + EMS_PAGESIZE * ems_map.log_page[pg] + off;
+}
+
+// One side of a block transfer: conventional memory or an EMS handle.
+struct xfer_ptr
+{
+    struct ems_data *ems;
+    uint32_t addr;
+};
+
+static uint8_t *xfer_span(const struct xfer_ptr *p, unsigned *len)
+{
+    if(p->ems)
+        return p->ems->memory + p->addr;
+    return conv_span(p->addr, len);
+}
+
+// Exchanges two non overlapping memory blocks
+static void swap_mem(uint8_t *a, uint8_t *b, unsigned len)
+{
+    while(len >= 16)
+    {
+        uint64_t x[2], y[2];
+        memcpy(x, a, 16);
+        memcpy(y, b, 16);
+        memcpy(a, y, 16);
+        memcpy(b, x, 16);
+        a += 16;
+        b += 16;
+        len -= 16;
+    }
+    while(len--)
+    {
+        uint8_t t = *a;
+        *a++ = *b;
+        *b++ = t;
+    }
+}
+
+// Moves or exchanges memory, one contiguous span at a time. Unmapped pages
+// of the page frame read as 0xFF and ignore writes.
+static void block_xfer(struct xfer_ptr src, struct xfer_ptr dest, uint32_t len,
+                       int exchange)
+{
+    while(len)
+    {
+        unsigned n = len, n2;
+        uint8_t *s = xfer_span(&src, &n);
+        n2 = n;
+        uint8_t *d = xfer_span(&dest, &n2);
+        n = n2;
+        if(exchange && s && d)
+            swap_mem(d, s, n);
+        else if(exchange && s)
+            memset(s, 0xFF, n);
+        else if(exchange && d)
+            memset(d, 0xFF, n);
+        else if(d)
+        {
+            if(s)
+                memmove(d, s, n);
+            else
+                memset(d, 0xFF, n);
+        }
+        src.addr += n;
+        dest.addr += n;
+        len -= n;
+    }
+}
+
 int ems_putmem(uint32_t dest, const uint8_t *src, unsigned size)
 {
-    unsigned i;
-    for(i = 0; i < size; i++)
-        ems_put8(dest++, *src++);
+    while(size)
+    {
+        unsigned n = size;
+        uint8_t *d = conv_span(dest, &n);
+        if(d)
+            memcpy(d, src, n);
+        dest += n;
+        src += n;
+        size -= n;
+    }
     return 0;
 }
 
-/* XXX This function may be slow, so fix in the future */
 int ems_getmem(uint8_t *dest, uint32_t src, unsigned size)
 {
-    unsigned i;
-    for(i = 0; i < size; i++)
-        *dest++ = ems_get8(src++);
+    while(size)
+    {
+        unsigned n = size;
+        uint8_t *s = conv_span(src, &n);
+        if(s)
+            memcpy(dest, s, n);
+        else
+            memset(dest, 0xFF, n);
+        dest += n;
+        src += n;
+        size -= n;
+    }
     return 0;
 }
 
+void ems_memmove(uint32_t dest, uint32_t src, unsigned size)
+{
+    struct xfer_ptr s = {NULL, src}, d = {NULL, dest};
+    if(!in_ems_pageframe2(src, size) && !in_ems_pageframe2(dest, size))
+    {
+        memmove(memory + dest, memory + src, size);
+        return;
+    }
+    if(dest > src && dest < src + size)
+    {
+        // Copy backwards, so overlapping data is read before being written
+        unsigned n = dest - src;
+        while(size > n)
+        {
+            size -= n;
+            s.addr = src + size;
+            d.addr = dest + size;
+            block_xfer(s, d, n, 0);
+        }
+        s.addr = src;
+        d.addr = dest;
+    }
+    block_xfer(s, d, size, 0);
+}
+
+BIOS_IRET(intr67)
+
 void init_ems(int pages)
 {
     ems_freepages = ems_maxpages = pages;
@@ -198,6 +329,7 @@ void init_ems(int pages)
     put16(0x67 * 4 + 2, ems_header_seg);
 
     use_ems = 1;
+    reg_bios_routine(0x67, intr67_iret);
 }
 
 static struct ems_data **search_handle(unsigned handle)
@@ -322,13 +454,12 @@ void intr67(void)
         }
 
         int size = sizeof(struct ems_data) + EMS_PAGESIZE * alloc_pages;
-        struct ems_data *new_ems = malloc(size);
+        struct ems_data *new_ems = calloc(1, size);
         if(new_ems == NULL)
         {
             set_emm_result(ax, EMM_STATUS_MALFUNCTION_SOFT);
             break;
         }
-        memset(new_ems, 0, sizeof(struct ems_data));
         new_ems->pages = alloc_pages;
         new_ems->handle = handle;
         *pp = new_ems;
@@ -661,6 +792,10 @@ void intr67(void)
         ems_freepages += (*pp)->pages;
         int size = sizeof(struct ems_data) + EMS_PAGESIZE * alloc_pages;
         struct ems_data *new_ems = realloc(*pp, size);
+        // Clear new pages, so runs don't depend on the host memory contents
+        if(alloc_pages > new_ems->pages)
+            memset(new_ems->memory + EMS_PAGESIZE * new_ems->pages, 0,
+                   EMS_PAGESIZE * (alloc_pages - new_ems->pages));
         new_ems->pages = alloc_pages;
         *pp = new_ems;
         ems_freepages -= new_ems->pages;
@@ -939,161 +1074,76 @@ void intr67(void)
             dest_ems = *pp;
         }
         int overlapped = 0;
+        struct xfer_ptr src = {src_ems, 0}, dest = {dest_ems, 0};
 
-        if(src_ems == NULL && dest_ems == NULL)
-        { /* conv-to-conv */
-            uint32_t src_addr = cpuGetAddress(src_pg, src_offset);
-            uint32_t dest_addr = cpuGetAddress(dest_pg, dest_offset);
-            if(src_addr < dest_addr)
-            {
-                if(src_addr + len > dest_addr)
-                {
-                    overlapped = 1;
-                    for(int i = len - 1; i >= 0; i--)
-                    {
-                        if(exchange)
-                        {
-                            uint8_t tmp = get8(dest_addr + 1);
-                            put8(dest_addr + i, get8(src_addr + i));
-                            put8(src_addr + i, tmp);
-                        }
-                        else
-                        {
-                            put8(dest_addr + i, get8(src_addr + i));
-                        }
-                    }
-                }
-                else
-                {
-                    for(int i = 0; i < len; i++)
-                    {
-                        if(exchange)
-                        {
-                            uint8_t tmp = get8(dest_addr + 1);
-                            put8(dest_addr + i, get8(src_addr + i));
-                            put8(src_addr + i, tmp);
-                        }
-                        else
-                        {
-                            put8(dest_addr + i, get8(src_addr + i));
-                        }
-                    }
-                }
-            }
-            else
-            {
-                if(src_addr < dest_addr + len)
-                    overlapped = 1;
-                for(int i = 0; i < len; i++)
-                {
-                    if(exchange)
-                    {
-                        uint8_t tmp = get8(dest_addr + 1);
-                        put8(dest_addr + i, get8(src_addr + i));
-                        put8(src_addr + i, tmp);
-                    }
-                    else
-                    {
-                        put8(dest_addr + i, get8(src_addr + i));
-                    }
-                }
-            }
+        if(len > 0x100000)
+        {
+            set_emm_result(ax, EMM_STATUS_REGION_EXCEEDS_1M);
+            break;
         }
-        else if(src_ems != NULL && dest_ems == NULL)
-        { /* ems-to-conv */
-            uint32_t dest_addr = cpuGetAddress(dest_pg, dest_offset);
-            int end_pg = src_pg + (src_offset + len) / EMS_PAGESIZE;
-            if(src_ems->pages < end_pg)
-            {
-                set_emm_result(ax, EMM_STATUS_EMS_SRC_OR_DEST_IS_OUT_OF_RANGE);
-                break;
-            }
-            src_offset += src_pg * EMS_PAGESIZE;
 
-            if(exchange)
-            {
-                uint8_t *buf = malloc(len);
-                if(buf == NULL)
-                {
-                    set_emm_result(ax, EMM_STATUS_MALFUNCTION_SOFT);
-                    break;
-                }
-                ems_getmem(buf, dest_addr, len);
-                ems_putmem(dest_addr, &src_ems->memory[src_offset], len);
-                memcpy(&src_ems->memory[src_offset], buf, len);
-                free(buf);
-            }
-            else
+        if(src_ems)
+        {
+            if(src_offset >= EMS_PAGESIZE)
             {
-                ems_putmem(dest_addr, &src_ems->memory[src_offset], len);
+                set_emm_result(ax, EMM_STATUS_OFFSET_IS_OUT_OF_RANGE);
+                break;
             }
-        }
-        else if(src_ems == NULL && dest_ems != NULL)
-        { /* conv-to-ems */
-            uint32_t src_addr = cpuGetAddress(src_pg, src_offset);
-            int end_pg = dest_pg + (dest_offset + len) / EMS_PAGESIZE;
-            if(dest_ems->pages < end_pg)
+            if(src_ems->pages <
+               src_pg + (src_offset + len + EMS_PAGESIZE - 1) / EMS_PAGESIZE)
             {
                 set_emm_result(ax, EMM_STATUS_EMS_SRC_OR_DEST_IS_OUT_OF_RANGE);
                 break;
             }
-            dest_offset += dest_pg * EMS_PAGESIZE;
-
-            if(exchange)
-            {
-                uint8_t *buf = malloc(len);
-                if(buf == NULL)
-                {
-                    set_emm_result(ax, EMM_STATUS_MALFUNCTION_SOFT);
-                    break;
-                }
-                ems_getmem(buf, src_addr, len);
-                ems_putmem(src_addr, &dest_ems->memory[dest_offset], len);
-                memcpy(&dest_ems->memory[dest_offset], buf, len);
-                free(buf);
-            }
-            else
-            {
-                ems_getmem(&dest_ems->memory[dest_offset], src_addr, len);
-            }
+            src.addr = src_pg * EMS_PAGESIZE + src_offset;
         }
         else
-        { // ems-to-ems
-            int src_end_pg = src_pg + (src_offset + len) / EMS_PAGESIZE;
-            int dest_end_pg = dest_pg + (dest_offset + len) / EMS_PAGESIZE;
-            if(src_ems->pages < src_end_pg || dest_ems->pages < dest_end_pg)
+            src.addr = cpuGetAddress(src_pg, src_offset);
+        if(dest_ems)
+        {
+            if(dest_offset >= EMS_PAGESIZE)
             {
-                set_emm_result(ax, EMM_STATUS_EMS_SRC_OR_DEST_IS_OUT_OF_RANGE);
+                set_emm_result(ax, EMM_STATUS_OFFSET_IS_OUT_OF_RANGE);
                 break;
             }
-            src_offset += src_pg * EMS_PAGESIZE;
-            dest_offset += dest_pg * EMS_PAGESIZE;
-
-            if((src_ems == dest_ems) &&
-               ((src_offset < dest_offset && (src_offset + len) > dest_offset) ||
-                (src_offset > dest_offset && src_offset < (dest_offset + len))))
+            if(dest_ems->pages <
+               dest_pg + (dest_offset + len + EMS_PAGESIZE - 1) / EMS_PAGESIZE)
             {
-                overlapped = 1;
+                set_emm_result(ax, EMM_STATUS_EMS_SRC_OR_DEST_IS_OUT_OF_RANGE);
+                break;
             }
+            dest.addr = dest_pg * EMS_PAGESIZE + dest_offset;
+        }
+        else
+            dest.addr = cpuGetAddress(dest_pg, dest_offset);
+        if((!src_ems && src.addr + len > 0x100000) ||
+           (!dest_ems && dest.addr + len > 0x100000))
+        {
+            set_emm_result(ax, EMM_STATUS_1M_WRAP_DURING_MOVE_EXCHANGE);
+            break;
+        }
+
+        if(src_ems == dest_ems && src.addr < dest.addr + len && dest.addr < src.addr + len)
+        {
             if(exchange)
             {
-                uint8_t *buf = malloc(len);
-                if(buf == NULL)
-                {
-                    set_emm_result(ax, EMM_STATUS_MALFUNCTION_SOFT);
-                    break;
-                }
-                memcpy(buf, &dest_ems->memory[dest_offset], len);
-                memcpy(&dest_ems->memory[dest_offset], &src_ems->memory[src_offset], len);
-                memcpy(&src_ems->memory[src_offset], buf, len);
-                free(buf);
+                set_emm_result(ax, EMM_STATUS_EMS_SRC_AND_DEST_IS_OVERLAPPED_INVALID);
+                break;
             }
+            overlapped = 1;
+        }
+        if(src_ems && dest_ems)
+        {
+            // EMS handle memory is contiguous
+            if(exchange)
+                swap_mem(dest_ems->memory + dest.addr, src_ems->memory + src.addr, len);
             else
-            {
-                memmove(&dest_ems->memory[dest_offset], &src_ems->memory[src_offset],
-                        len);
-            }
+                memmove(dest_ems->memory + dest.addr, src_ems->memory + src.addr, len);
         }
+        else if(!src_ems && !dest_ems && !exchange)
+            ems_memmove(dest.addr, src.addr, len);
+        else
+            block_xfer(src, dest, len, exchange);
         set_emm_result(ax, overlapped ? EMM_STATUS_EMS_SRC_AND_DEST_IS_OVERLAPPED_VALID
                                       : EMM_STATUS_SUCCESS);
     }
@@ -6,9 +6,11 @@
 #include <string.h>
 
 extern volatile int exit_cpu;
+// Instructions left to execute before the next timer tick
+extern long cpu_steps;
 extern uint32_t memory_mask;
 extern uint32_t memory_limit;
-uint8_t *memory;
+extern uint8_t *memory;
 
 int cpuGetAddress(uint16_t segment, uint16_t offset);
 int cpuGetAddrDS(uint16_t offset);
@@ -22,6 +24,20 @@ uint8_t read_port(unsigned port);
 void write_port(unsigned port, uint8_t value);
 int bios_routine(unsigned inum);
 
+// Handler for one of our interrupt vectors, returns 1 if it jumped to a new
+// CS:IP by itself or 0 to return to the caller with IRET.
+typedef int (*bios_handler)(void);
+// Installs "func" as the handler of interrupt "inum", returns the old one.
+bios_handler reg_bios_routine(unsigned inum, bios_handler func);
+// Defines name_iret(), a bios_handler for a "void name(void)" handler that
+// always returns by IRET.
+#define BIOS_IRET(name)                                                        \
+    static int name##_iret(void)                                               \
+    {                                                                          \
+        name();                                                                \
+        return 0;                                                              \
+    }
+
 // CPU interface
 void execute(void); // 1 ins.
 void init_cpu(void);
@@ -123,6 +139,9 @@ void cpuClrStartupFlag(enum cpuFlags flag);
 // Helper functions to access memory
 #ifdef IA32
 
+// Drop the cached code page, call when the memory mapping changes
+void cpu_codefetch_flush(void);
+
 // Read 8 bit number
 void meml_write8(uint32_t address, uint8_t value);
 #define put8(addr, v) meml_write8(addr, v)
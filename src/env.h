@@ -18,3 +18,8 @@
 #define ENV_MEMSIZE   "EMU2_MEMSIZE"
 #define ENV_MEMFLAG   "EMU2_MEMFLAG"
 #define ENV_WINVER    "EMU2_WINVER"
+#define ENV_NOIDLE    "EMU2_NOIDLE"
+#define ENV_KEYS      "EMU2_KEYS"
+#define ENV_TURBO     "EMU2_TURBO"
+#define ENV_DETERM    "EMU2_DETERMINISTIC"
+#define ENV_INT_TIMES "EMU2_INT_TIMES"
@@ -3,6 +3,7 @@
 #include "dbg.h"
 #include "emu.h"
 #include "env.h"
+#include "utils.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -167,6 +168,9 @@ void set_a20_enable(int enable)
     else
         memory_mask = 0xfffff;
     debug(debug_int, "--A20 mask %08x--\n", memory_mask);
+#ifdef IA32
+    cpu_codefetch_flush();
+#endif
 }
 
 int query_a20_enable(void)
@@ -359,6 +363,8 @@ void xms_farcall(void)
         else
         {
             p->handle = 0;
+            release_guest_memory(memory + XMS_EMB_BASE + p->emb_offset * 1024,
+                                 p->kb_size * 1024);
             bl = XMM_STATUS_SUCCESS;
             cpuSetAX(0x0001);
         }
@@ -426,7 +432,12 @@ void xms_farcall(void)
             cpuSetAX(0x0000);
             break;
         }
-        memcpy(memory + dst_addr, memory + src_addr, len);
+#ifdef EMS_SUPPORT
+        if(in_ems_pageframe2(src_addr, len) || in_ems_pageframe2(dst_addr, len))
+            ems_memmove(dst_addr, src_addr, len);
+        else
+#endif
+            memmove(memory + dst_addr, memory + src_addr, len);
         bl = XMM_STATUS_SUCCESS;
         cpuSetAX(0x0001);
     }
@@ -21,6 +21,12 @@
 #define SUPPORT_FPU_SOFTFLOAT 1
 #define FPU_TYPE_SOFTFLOAT 0
 
+// Run packed MMX/SSE2 integer and double operations with host SSE2
+// instructions. Define NO_HOST_SIMD to force the portable lane loops.
+#if defined(__SSE2__) && !defined(NO_HOST_SIMD)
+#define USE_HOST_SSE2 1
+#endif
+
 typedef int      INT;
 typedef unsigned int UINT;
 
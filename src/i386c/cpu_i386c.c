@@ -4,6 +4,7 @@
 #include <../dbg.h>
 #define IA32 1
 #include <../emu.h>
+#include <../idle.h>
 
 extern int bios_routine(unsigned inum);
 extern void handle_irq(void);
@@ -88,30 +89,95 @@ emu2_int_debugout(const char *format, ...)
 }
 
 extern void IRET(void);
-void
-emu2_hook(void)
+
+// Runs our BIOS and DOS handlers when CS:IP is at one of the 0000:00xx
+// entry points, returns 1 if a handler was called.
+int
+emu2_bios_entry(void)
 {
     UINT32 addr;
-    int iret = 0;
-    if (!CPU_STAT_PM || CPU_STAT_VM86)
+
+    if (CPU_STAT_PM && !CPU_STAT_VM86)
+        return 0;
+    addr = CPU_EIP + (CPU_CS << 4);
+    if (addr >= 0x100)
+        return 0;
+    if (bios_routine(addr & 0xFF))
+        return 1;   // The handler already jumped to the new CS:IP
+    debug_regs();
+    if (!CPU_STAT_PM)
     {
-        addr = CPU_EIP + (CPU_CS << 4);
-        if(addr < 0x100)
-        {
-            iret = !bios_routine(addr & 0xFF);
-        }
+        // Return to the caller now instead of running the IRET at FFFE:000F
+        debug(debug_cpu, "%04x:%08x: %s%s\n",
+              CPU_CS, CPU_EIP, "??                      ", "(iret)");
+        CPU_PREV_EIP = CPU_EIP;
+        CPU_STATSAVE.cpu_inst = CPU_STATSAVE.cpu_inst_default;
+        IRET();
     }
-    debug_regs();
-    if(iret)
+    else
     {
-        //JMP to IRET address
-		CPU_IP = 0x000F;
-		LOAD_SEGREG(CPU_CS_INDEX, 0xFFFE);
+        // In V86 mode the IRET can trap to the monitor, so it must run
+        // as a guest instruction.
+        CPU_IP = 0x000F;
+        LOAD_SEGREG(CPU_CS_INDEX, 0xFFFE);
         debug(debug_cpu, "%04x:%08x: %s%s\n",
               CPU_CS, CPU_EIP, "??                      ", "(iret)");
-		//IRET();
-        debug_regs();
     }
+    return 1;
+}
+
+/* A backward jump that arrives at the same CS:EIP with the same registers
+   and flags, and without any memory change since the last time, is a loop
+   waiting for something external (the BIOS tick, an interrupt handler...),
+   so report it as an unsuccessful poll, unless the loop already polls
+   through a BIOS call or a port read, as check_spin() in cpu.c does.  */
+static struct
+{
+    UINT32 regs[CPU_REG_NUM];
+    UINT16 sregs[CPU_SEGREG_NUM];
+    UINT32 eip;
+    UINT32 flags;
+    unsigned mem_changes;
+    unsigned polls;
+} spin;
+
+void
+emu2_check_spin(void)
+{
+    int i, same = spin.eip == CPU_EIP && spin.flags == CPU_EFLAG &&
+                  spin.mem_changes == idle_mem_changes &&
+                  spin.polls == idle_polls;
+
+    for (i = 0; i < CPU_REG_NUM; i++) {
+        if (spin.regs[i] != CPU_REGS_DWORD(i)) {
+            spin.regs[i] = CPU_REGS_DWORD(i);
+            same = 0;
+        }
+    }
+    for (i = 0; i < CPU_SEGREG_NUM; i++) {
+        if (spin.sregs[i] != CPU_REGS_SREG(i)) {
+            spin.sregs[i] = CPU_REGS_SREG(i);
+            same = 0;
+        }
+    }
+    if (same) {
+        idle_poll();
+        spin.polls = idle_polls;
+        return;
+    }
+    spin.eip = CPU_EIP;
+    spin.flags = CPU_EFLAG;
+    spin.mem_changes = idle_mem_changes;
+    spin.polls = idle_polls;
+}
+
+void
+emu2_hook(void)
+{
+    // Called before each instruction, ia32_step() runs a few of them
+    cpu_steps--;
+    emu2_bios_entry();
+    debug_regs();
 }
 
 extern volatile int exit_cpu;
@@ -119,11 +185,19 @@ extern volatile int exit_cpu;
 void execute(void)
 {
     CPU_BASECLOCK = 100; // each operation step must be lower than 100 tick
-    for(; !exit_cpu;) {
+    for(; !exit_cpu && cpu_steps > 0;) {
         CPU_REMCLOCK = CPU_BASECLOCK;
         if (CPU_EFLAG & I_FLAG)
             handle_irq();
         ia32_step();
+        if (CPU_STAT_HLT) {
+            // With interrupts disabled nothing can wake us up
+            if (!(CPU_EFLAG & I_FLAG)) {
+                printf("HALT instruction!\n");
+                exit(0);
+            }
+            idle_halt();
+        }
     }
 }
 
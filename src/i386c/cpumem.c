@@ -4,6 +4,7 @@
 #ifdef EMS_SUPPORT
 #include <../ems.h>
 #endif
+#include <../idle.h>
 
 #if 1
 #undef TRACEOUT
@@ -31,6 +32,23 @@
 
 extern uint8_t *memory;
 extern uint32_t memory_mask;
+
+// Returns the host address for a "size" bytes access at "address", or NULL
+// if the access touches the EMS page frame or wraps around the memory mask.
+static inline UINT8 *
+memp_direct(UINT32 address, UINT size)
+{
+    UINT32 a = address & memory_mask;
+
+#ifdef EMS_SUPPORT
+    if (in_ems_pageframe2(address, size))
+        return NULL;
+#endif
+    if (((address + size - 1) & memory_mask) != a + size - 1)
+        return NULL;
+    return memory + a;
+}
+
 REG8 MEMCALL
 memp_read8(UINT32 address)
 {
@@ -44,12 +62,20 @@ memp_read8(UINT32 address)
 REG16 MEMCALL
 memp_read16(UINT32 address)
 {
+    const UINT8 *p = memp_direct(address, 2);
+
+    if (p)
+        return LOADINTELWORD(p);
     return (memp_read8(address+1) << 8) | memp_read8(address);
 }
 
 UINT32 MEMCALL
 memp_read32(UINT32 address)
 {
+    const UINT8 *p = memp_direct(address, 4);
+
+    if (p)
+        return LOADINTELDWORD(p);
     return ((UINT32)memp_read16(address+2) << 16) | memp_read16(address);
 }
 
@@ -59,16 +85,29 @@ memp_write8(UINT32 address, REG8 value)
 #ifdef EMS_SUPPORT
     if (in_ems_pageframe(address))
     {
+        if (ems_get8(address) != value)
+            idle_mem_changes++;
         ems_put8(address, value);
         return;
     }
 #endif
+    if (memory[address & memory_mask] != value)
+        idle_mem_changes++;
     memory[address & memory_mask] = value;
 }
 
 void MEMCALL
 memp_write16(UINT32 address, REG16 value)
 {
+    UINT8 *p = memp_direct(address, 2);
+
+    if (p)
+    {
+        if (LOADINTELWORD(p) != value)
+            idle_mem_changes++;
+        STOREINTELWORD(p, value);
+        return;
+    }
     memp_write8(address, value & 0xff);
     memp_write8(address+1, value >> 8);
 }
@@ -76,6 +115,15 @@ memp_write16(UINT32 address, REG16 value)
 void MEMCALL
 memp_write32(UINT32 address, UINT32 value)
 {
+    UINT8 *p = memp_direct(address, 4);
+
+    if (p)
+    {
+        if (LOADINTELDWORD(p) != value)
+            idle_mem_changes++;
+        STOREINTELDWORD(p, value);
+        return;
+    }
     memp_write16(address, value & 0xffff);
     memp_write16(address+2, value >> 16);
 }
@@ -98,6 +146,20 @@ memp_read32_codefetch(UINT32 address)
     return memp_read32(address);
 }
 
+// Returns the host address of the 4KB page containing "address", or NULL if
+// the page can't be read directly.
+const UINT8 * MEMCALL
+memp_codefetch_page(UINT32 address)
+{
+    address &= ~0xfff;
+#ifdef EMS_SUPPORT
+    // The mapping of the EMS page frame can change at any time
+    if (in_ems_pageframe(address))
+        return NULL;
+#endif
+    return memory + (address & memory_mask);
+}
+
 // ----
 REG8 MEMCALL
 memp_read8_paging(UINT32 address)
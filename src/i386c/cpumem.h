@@ -35,6 +35,7 @@ void MEMCALL memp_writes(UINT32 address, const void *dat, UINT leng);
 REG8 MEMCALL memp_read8_codefetch(UINT32 address);
 REG16 MEMCALL memp_read16_codefetch(UINT32 address);
 UINT32 MEMCALL memp_read32_codefetch(UINT32 address);
+const UINT8 * MEMCALL memp_codefetch_page(UINT32 address);
 REG8 MEMCALL memp_read8_paging(UINT32 address);
 REG16 MEMCALL memp_read16_paging(UINT32 address);
 UINT32 MEMCALL memp_read32_paging(UINT32 address);
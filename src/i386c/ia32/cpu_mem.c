@@ -368,6 +368,81 @@ exc:
 }
 
 
+/*
+ * code fetch window: host pointer to the rest of the current code page, so
+ * that instruction bytes are read without the segment, paging and memory
+ * checks.  Flushed on CS loads, TLB flushes and A20 changes, and keyed with
+ * the CS base for the real mode segment loads.
+ */
+static struct {
+	UINT32 segbase;		/* CS base when filled */
+	UINT32 start;		/* CS offset of the first byte */
+	UINT32 size;		/* bytes available, 0 if invalid */
+	const UINT8 *ptr;	/* host address of the first byte */
+} fetch_window;
+
+void MEMCALL
+cpu_codefetch_flush(void)
+{
+
+	fetch_window.size = 0;
+}
+
+/* Returns the number of bytes available in the window at "offset". */
+STATIC_INLINE UINT32
+fetch_window_avail(UINT32 offset)
+{
+	UINT32 off = offset - fetch_window.start;
+
+	if (off < fetch_window.size
+	 && fetch_window.segbase == CPU_CS_DESC.u.seg.segbase)
+		return fetch_window.size - off;
+	return 0;
+}
+
+/* Maps the code page at "offset", the slow path handles the faults. */
+static UINT32
+fetch_window_fill(UINT32 offset)
+{
+	const int ucrw = CPU_PAGE_READ_CODE | CPU_STAT_USER_MODE;
+	descriptor_t *sdp;
+	const UINT8 *page;
+	UINT32 laddr, paddr, size;
+
+	fetch_window.size = 0;
+	sdp = &CPU_CS_DESC;
+	if (CPU_STAT_PM && offset > sdp->u.seg.limit)
+		return 0;
+
+	laddr = sdp->u.seg.segbase + offset;
+	paddr = CPU_STAT_PAGING ? laddr2paddr(laddr, ucrw) : laddr;
+	page = memp_codefetch_page(paddr);
+	if (page == NULL)
+		return 0;
+
+	size = CPU_PAGE_SIZE - (laddr & CPU_PAGE_MASK);
+	if (CPU_STAT_PM && size - 1 > sdp->u.seg.limit - offset)
+		size = sdp->u.seg.limit - offset + 1;
+
+	fetch_window.segbase = sdp->u.seg.segbase;
+	fetch_window.start = offset;
+	fetch_window.size = size;
+	fetch_window.ptr = page + (paddr & CPU_PAGE_MASK);
+	return size;
+}
+
+STATIC_INLINE const UINT8 *
+fetch_window_ptr(UINT32 offset, UINT32 len)
+{
+	UINT32 avail = fetch_window_avail(offset);
+
+	if (avail == 0)
+		avail = fetch_window_fill(offset);
+	if (avail >= len)
+		return fetch_window.ptr + (offset - fetch_window.start);
+	return NULL;
+}
+
 /*
  * code fetch
  */
@@ -375,9 +450,14 @@ UINT8 MEMCALL
 cpu_codefetch(UINT32 offset)
 {
 	const int ucrw = CPU_PAGE_READ_CODE | CPU_STAT_USER_MODE;
+	const UINT8 *p;
 	descriptor_t *sdp;
 	UINT32 addr;
 
+	p = fetch_window_ptr(offset, 1);
+	if (p != NULL)
+		return *p;
+
 	sdp = &CPU_CS_DESC;
 	addr = sdp->u.seg.segbase + offset;
 
@@ -394,9 +474,14 @@ UINT16 MEMCALL
 cpu_codefetch_w(UINT32 offset)
 {
 	const int ucrw = CPU_PAGE_READ_CODE | CPU_STAT_USER_MODE;
+	const UINT8 *p;
 	descriptor_t *sdp;
 	UINT32 addr;
 
+	p = fetch_window_ptr(offset, 2);
+	if (p != NULL)
+		return LOADINTELWORD(p);
+
 	sdp = &CPU_CS_DESC;
 	addr = sdp->u.seg.segbase + offset;
 
@@ -413,9 +498,14 @@ UINT32 MEMCALL
 cpu_codefetch_d(UINT32 offset)
 {
 	const int ucrw = CPU_PAGE_READ_CODE | CPU_STAT_USER_MODE;
+	const UINT8 *p;
 	descriptor_t *sdp;
 	UINT32 addr;
 
+	p = fetch_window_ptr(offset, 4);
+	if (p != NULL)
+		return LOADINTELDWORD(p);
+
 	sdp = &CPU_CS_DESC;
 	addr = sdp->u.seg.segbase + offset;
 
@@ -72,6 +72,7 @@ UINT32 MEMCALL cpu_vmemory_RMW_d(int idx, UINT32 offset, UINT32 (CPUCALL *func)(
 UINT8 MEMCALL cpu_codefetch(UINT32 offset);
 UINT16 MEMCALL cpu_codefetch_w(UINT32 offset);
 UINT32 MEMCALL cpu_codefetch_d(UINT32 offset);
+void MEMCALL cpu_codefetch_flush(void);
 
 /*
  * additional physical address function
@@ -38,6 +38,9 @@
 #include <bios/bios.h>
 #endif
 
+/* emu2 idle detection, called on each taken backward short jump */
+extern void emu2_check_spin(void);
+
 
 /*
  * JMP
@@ -1380,6 +1383,8 @@ INTO(void)
 	INTERRUPT(4, INTR_TYPE_SOFTINTR);
 }
 
+extern int emu2_bios_entry(void);
+
 void
 INT_Ib(void)
 {
@@ -1392,6 +1397,9 @@ INT_Ib(void)
 		softinttrap(CPU_CS, CPU_EIP - 2, vect);
 #endif
 		INTERRUPT(vect, INTR_TYPE_SOFTINTR);
+		/* emu2 service vectors run here, without another step */
+		if (!CPU_STAT_PM)
+			emu2_bios_entry();
 		return;
 	}
 	VERBOSE(("INT_Ib: VM86 && IOPL < 3 && INTn"));
@@ -34,6 +34,45 @@
 
 #define CPU_MMXWORKCLOCK	CPU_WORKCLOCK(2)
 
+#if defined(USE_HOST_SSE2)
+#include <emmintrin.h>
+
+// MMXレジスタはホストのxmmレジスタの下位64bitで処理する
+// (ホストのMMX命令はx87の状態を壊すので使わない)
+#define MMX_HOST_OP3(dst, src1, src2, func) \
+	_mm_storel_epi64((__m128i*)(dst), func(_mm_loadl_epi64((const __m128i*)(src1)), _mm_loadl_epi64((const __m128i*)(src2))))
+#define MMX_HOST_OP(dst, src, func)	MMX_HOST_OP3(dst, dst, src, func)
+
+static INLINE __m128i
+mmx_host_packs_pi16(__m128i a, __m128i b)
+{
+	a = _mm_unpacklo_epi64(a, b);
+	return _mm_packs_epi16(a, a);
+}
+static INLINE __m128i
+mmx_host_packs_pi32(__m128i a, __m128i b)
+{
+	a = _mm_unpacklo_epi64(a, b);
+	return _mm_packs_epi32(a, a);
+}
+static INLINE __m128i
+mmx_host_packs_pu16(__m128i a, __m128i b)
+{
+	a = _mm_unpacklo_epi64(a, b);
+	return _mm_packus_epi16(a, a);
+}
+static INLINE __m128i
+mmx_host_unpackhi_pi8(__m128i a, __m128i b)
+{
+	return _mm_srli_si128(_mm_unpacklo_epi8(a, b), 8);
+}
+static INLINE __m128i
+mmx_host_unpackhi_pi16(__m128i a, __m128i b)
+{
+	return _mm_srli_si128(_mm_unpacklo_epi16(a, b), 8);
+}
+#endif
+
 static INLINE void
 MMX_check_NM_EXCEPTION(){
 	// MMXなしならUD(無効オペコード例外)を発生させる
@@ -199,8 +238,6 @@ void MMX_PACKSSWB(void)
 	INT16 *srcreg1;
 	INT16 *srcreg2;
 	INT8 *dstreg;
-	INT8 dstregbuf[8];
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -221,6 +258,11 @@ void MMX_PACKSSWB(void)
 		srcreg2 = srcregbuf.w;
 		dstreg = (INT8*)(&(FPU_STAT.reg[idx]));
 	}
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP3(dstreg, srcreg1, srcreg2, mmx_host_packs_pi16);
+#else
+	INT8 dstregbuf[8];
+	int i;
 	for(i=0;i<4;i++){
 		if(srcreg1[i] > 127){
 			dstregbuf[i] = 127;
@@ -242,6 +284,7 @@ void MMX_PACKSSWB(void)
 	for(i=0;i<8;i++){
 		dstreg[i] = dstregbuf[i];
 	}
+#endif
 }
 void MMX_PACKSSDW(void)
 {
@@ -251,8 +294,6 @@ void MMX_PACKSSDW(void)
 	INT32 *srcreg1;
 	INT32 *srcreg2;
 	INT16 *dstreg;
-	INT16 dstregbuf[4];
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -273,6 +314,11 @@ void MMX_PACKSSDW(void)
 		srcreg2 = srcregbuf.d;
 		dstreg = (INT16*)(&(FPU_STAT.reg[idx]));
 	}
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP3(dstreg, srcreg1, srcreg2, mmx_host_packs_pi32);
+#else
+	INT16 dstregbuf[4];
+	int i;
 	for(i=0;i<2;i++){
 		if(srcreg1[i] > 32767){
 			dstregbuf[i] = 32767;
@@ -294,6 +340,7 @@ void MMX_PACKSSDW(void)
 	for(i=0;i<4;i++){
 		dstreg[i] = dstregbuf[i];
 	}
+#endif
 }
 
 void MMX_PACKUSWB(void)
@@ -304,8 +351,6 @@ void MMX_PACKUSWB(void)
 	INT16 *srcreg1;
 	INT16 *srcreg2;
 	UINT8 *dstreg;
-	UINT8 dstregbuf[8];
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -326,6 +371,11 @@ void MMX_PACKUSWB(void)
 		srcreg2 = srcregbuf.w;
 		dstreg = (UINT8*)(&(FPU_STAT.reg[idx]));
 	}
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP3(dstreg, srcreg1, srcreg2, mmx_host_packs_pu16);
+#else
+	UINT8 dstregbuf[8];
+	int i;
 	for(i=0;i<4;i++){
 		if(srcreg1[i] > 255){
 			dstregbuf[i] = 255;
@@ -347,6 +397,7 @@ void MMX_PACKUSWB(void)
 	for(i=0;i<8;i++){
 		dstreg[i] = dstregbuf[i];
 	}
+#endif
 }
 
 // *********** PADD
@@ -358,7 +409,6 @@ void MMX_PADDB(void)
 	MMXREG srcregbuf;
 	UINT8 *srcreg;
 	UINT8 *dstreg;
-	int i;
 
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -377,9 +427,14 @@ void MMX_PADDB(void)
 	}
 	dstreg = (UINT8*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_add_epi8);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		dstreg[i] += srcreg[i];
 	}
+#endif
 }
 void MMX_PADDW(void)
 {
@@ -388,7 +443,6 @@ void MMX_PADDW(void)
 	MMXREG srcregbuf;
 	UINT16 *srcreg;
 	UINT16 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -407,9 +461,14 @@ void MMX_PADDW(void)
 	}
 	dstreg = (UINT16*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_add_epi16);
+#else
+	int i;
 	for(i=0;i<4;i++){
 		dstreg[i] += srcreg[i];
 	}
+#endif
 }
 void MMX_PADDD(void)
 {
@@ -418,7 +477,6 @@ void MMX_PADDD(void)
 	MMXREG srcregbuf;
 	UINT32 *srcreg;
 	UINT32 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -437,9 +495,14 @@ void MMX_PADDD(void)
 	}
 	dstreg = (UINT32*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_add_epi32);
+#else
+	int i;
 	for(i=0;i<2;i++){
 		dstreg[i] += srcreg[i];
 	}
+#endif
 }
 
 void MMX_PADDSB(void)
@@ -449,7 +512,6 @@ void MMX_PADDSB(void)
 	MMXREG srcregbuf;
 	INT8 *srcreg;
 	INT8 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -468,6 +530,10 @@ void MMX_PADDSB(void)
 	}
 	dstreg = (INT8*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_adds_epi8);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		INT16 cbuf = (INT16)dstreg[i] + (INT16)srcreg[i];
 		if(cbuf > 127){
@@ -478,6 +544,7 @@ void MMX_PADDSB(void)
 			dstreg[i] = (INT8)cbuf;
 		}
 	}
+#endif
 }
 void MMX_PADDSW(void)
 {
@@ -486,7 +553,6 @@ void MMX_PADDSW(void)
 	MMXREG srcregbuf;
 	INT16 *srcreg;
 	INT16 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -505,6 +571,10 @@ void MMX_PADDSW(void)
 	}
 	dstreg = (INT16*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_adds_epi16);
+#else
+	int i;
 	for(i=0;i<4;i++){
 		INT32 cbuf = (INT32)dstreg[i] + (INT32)srcreg[i];
 		if(cbuf > 32767){
@@ -515,6 +585,7 @@ void MMX_PADDSW(void)
 			dstreg[i] = (INT16)cbuf;
 		}
 	}
+#endif
 }
 
 void MMX_PADDUSB(void)
@@ -524,7 +595,6 @@ void MMX_PADDUSB(void)
 	MMXREG srcregbuf;
 	UINT8 *srcreg;
 	UINT8 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -543,6 +613,10 @@ void MMX_PADDUSB(void)
 	}
 	dstreg = (UINT8*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_adds_epu8);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		UINT16 cbuf = (UINT16)dstreg[i] + (UINT16)srcreg[i];
 		if(cbuf > 255){
@@ -551,6 +625,7 @@ void MMX_PADDUSB(void)
 			dstreg[i] = (UINT8)cbuf;
 		}
 	}
+#endif
 }
 void MMX_PADDUSW(void)
 {
@@ -559,7 +634,6 @@ void MMX_PADDUSW(void)
 	MMXREG srcregbuf;
 	UINT16 *srcreg;
 	UINT16 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -578,6 +652,10 @@ void MMX_PADDUSW(void)
 	}
 	dstreg = (UINT16*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_adds_epu16);
+#else
+	int i;
 	for(i=0;i<4;i++){
 		UINT32 cbuf = (UINT32)dstreg[i] + (UINT32)srcreg[i];
 		if(cbuf > 65535){
@@ -586,6 +664,7 @@ void MMX_PADDUSW(void)
 			dstreg[i] = (UINT16)cbuf;
 		}
 	}
+#endif
 }
 
 // *********** PAND/ANDN,OR,XOR
@@ -714,7 +793,6 @@ void MMX_PCMPEQB(void)
 	MMXREG srcregbuf;
 	UINT8 *srcreg;
 	UINT8 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -733,6 +811,10 @@ void MMX_PCMPEQB(void)
 	}
 	dstreg = (UINT8*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_cmpeq_epi8);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		if(dstreg[i] == srcreg[i]){
 			dstreg[i] = 0xff;
@@ -740,6 +822,7 @@ void MMX_PCMPEQB(void)
 			dstreg[i] = 0;
 		}
 	}
+#endif
 }
 void MMX_PCMPEQW(void)
 {
@@ -748,7 +831,6 @@ void MMX_PCMPEQW(void)
 	MMXREG srcregbuf;
 	UINT16 *srcreg;
 	UINT16 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -767,6 +849,10 @@ void MMX_PCMPEQW(void)
 }
 	dstreg = (UINT16*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_cmpeq_epi16);
+#else
+	int i;
 	for(i=0;i<4;i++){
 		if(dstreg[i] == srcreg[i]){
 			dstreg[i] = 0xffff;
@@ -774,6 +860,7 @@ void MMX_PCMPEQW(void)
 			dstreg[i] = 0;
 		}
 	}
+#endif
 }
 void MMX_PCMPEQD(void)
 {
@@ -782,7 +869,6 @@ void MMX_PCMPEQD(void)
 	MMXREG srcregbuf;
 	UINT32 *srcreg;
 	UINT32 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -801,6 +887,10 @@ void MMX_PCMPEQD(void)
 	}
 	dstreg = (UINT32*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_cmpeq_epi32);
+#else
+	int i;
 	for(i=0;i<2;i++){
 		if(dstreg[i] == srcreg[i]){
 			dstreg[i] = 0xffffffff;
@@ -808,6 +898,7 @@ void MMX_PCMPEQD(void)
 			dstreg[i] = 0;
 		}
 	}
+#endif
 }
 
 // *********** PCMPGT
@@ -819,7 +910,6 @@ void MMX_PCMPGTB(void)
 	MMXREG srcregbuf;
 	INT8 *srcreg;
 	INT8 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -838,6 +928,10 @@ void MMX_PCMPGTB(void)
 	}
 	dstreg = (INT8*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_cmpgt_epi8);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		if(dstreg[i] > srcreg[i]){
 			dstreg[i] = 0xff;
@@ -845,6 +939,7 @@ void MMX_PCMPGTB(void)
 			dstreg[i] = 0;
 		}
 	}
+#endif
 }
 void MMX_PCMPGTW(void)
 {
@@ -853,7 +948,6 @@ void MMX_PCMPGTW(void)
 	MMXREG srcregbuf;
 	INT16 *srcreg;
 	INT16 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -872,6 +966,10 @@ void MMX_PCMPGTW(void)
 	}
 	dstreg = (INT16*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_cmpgt_epi16);
+#else
+	int i;
 	for(i=0;i<4;i++){
 		if(dstreg[i] > srcreg[i]){
 			dstreg[i] = 0xffff;
@@ -879,6 +977,7 @@ void MMX_PCMPGTW(void)
 			dstreg[i] = 0;
 		}
 	}
+#endif
 }
 void MMX_PCMPGTD(void)
 {
@@ -887,7 +986,6 @@ void MMX_PCMPGTD(void)
 	MMXREG srcregbuf;
 	INT32 *srcreg;
 	INT32 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -906,6 +1004,10 @@ void MMX_PCMPGTD(void)
 	}
 	dstreg = (INT32*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_cmpgt_epi32);
+#else
+	int i;
 	for(i=0;i<2;i++){
 		if(dstreg[i] > srcreg[i]){
 			dstreg[i] = 0xffffffff;
@@ -913,6 +1015,7 @@ void MMX_PCMPGTD(void)
 			dstreg[i] = 0;
 		}
 	}
+#endif
 }
 
 // *********** PMADDWD
@@ -958,7 +1061,6 @@ void MMX_PMULHW(void)
 	MMXREG srcregbuf;
 	INT16 *srcreg;
 	INT16 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -977,9 +1079,14 @@ void MMX_PMULHW(void)
 	}
 	dstreg = (INT16*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_mulhi_epi16);
+#else
+	int i;
 	for(i=0;i<4;i++){
 		dstreg[i] = (INT16)((((INT32)srcreg[i] * (INT32)dstreg[i]) >> 16) & 0xffff);
 	}
+#endif
 }
 void MMX_PMULLW(void)
 {
@@ -988,7 +1095,6 @@ void MMX_PMULLW(void)
 	MMXREG srcregbuf;
 	INT16 *srcreg;
 	INT16 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -1007,9 +1113,14 @@ void MMX_PMULLW(void)
 	}
 	dstreg = (INT16*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_mullo_epi16);
+#else
+	int i;
 	for(i=0;i<4;i++){
 		dstreg[i] = (INT16)((((INT32)srcreg[i] * (INT32)dstreg[i])) & 0xffff);
 	}
+#endif
 }
 
 // *********** PSLL
@@ -1414,7 +1525,6 @@ void MMX_PSUBB(void)
 	MMXREG srcregbuf;
 	UINT8 *srcreg;
 	UINT8 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -1433,9 +1543,14 @@ void MMX_PSUBB(void)
 	}
 	dstreg = (UINT8*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_sub_epi8);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		dstreg[i] -= srcreg[i];
 	}
+#endif
 }
 void MMX_PSUBW(void)
 {
@@ -1444,7 +1559,6 @@ void MMX_PSUBW(void)
 	MMXREG srcregbuf;
 	UINT16 *srcreg;
 	UINT16 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -1463,9 +1577,14 @@ void MMX_PSUBW(void)
 	}
 	dstreg = (UINT16*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_sub_epi16);
+#else
+	int i;
 	for(i=0;i<4;i++){
 		dstreg[i] -= srcreg[i];
 	}
+#endif
 }
 void MMX_PSUBD(void)
 {
@@ -1474,7 +1593,6 @@ void MMX_PSUBD(void)
 	MMXREG srcregbuf;
 	UINT32 *srcreg;
 	UINT32 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -1493,9 +1611,14 @@ void MMX_PSUBD(void)
 	}
 	dstreg = (UINT32*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_sub_epi32);
+#else
+	int i;
 	for(i=0;i<2;i++){
 		dstreg[i] -= srcreg[i];
 	}
+#endif
 }
 
 void MMX_PSUBSB(void)
@@ -1505,7 +1628,6 @@ void MMX_PSUBSB(void)
 	MMXREG srcregbuf;
 	INT8 *srcreg;
 	INT8 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -1524,6 +1646,10 @@ void MMX_PSUBSB(void)
 	}
 	dstreg = (INT8*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_subs_epi8);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		INT16 cbuf = (INT16)dstreg[i] - (INT16)srcreg[i];
 		if(cbuf > 127){
@@ -1534,6 +1660,7 @@ void MMX_PSUBSB(void)
 			dstreg[i] = (INT8)cbuf;
 		}
 	}
+#endif
 }
 void MMX_PSUBSW(void)
 {
@@ -1542,7 +1669,6 @@ void MMX_PSUBSW(void)
 	MMXREG srcregbuf;
 	INT16 *srcreg;
 	INT16 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -1561,6 +1687,10 @@ void MMX_PSUBSW(void)
 	}
 	dstreg = (INT16*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_subs_epi16);
+#else
+	int i;
 	for(i=0;i<4;i++){
 		INT32 cbuf = (INT32)dstreg[i] - (INT32)srcreg[i];
 		if(cbuf > 32767){
@@ -1571,6 +1701,7 @@ void MMX_PSUBSW(void)
 			dstreg[i] = (INT16)cbuf;
 		}
 	}
+#endif
 }
 
 void MMX_PSUBUSB(void)
@@ -1580,7 +1711,6 @@ void MMX_PSUBUSB(void)
 	MMXREG srcregbuf;
 	UINT8 *srcreg;
 	UINT8 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -1599,6 +1729,10 @@ void MMX_PSUBUSB(void)
 	}
 	dstreg = (UINT8*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_subs_epu8);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		INT16 cbuf = (INT16)dstreg[i] - (INT16)srcreg[i];
 		if(cbuf > 255){
@@ -1609,6 +1743,7 @@ void MMX_PSUBUSB(void)
 			dstreg[i] = (UINT8)cbuf;
 		}
 	}
+#endif
 }
 void MMX_PSUBUSW(void)
 {
@@ -1617,7 +1752,6 @@ void MMX_PSUBUSW(void)
 	MMXREG srcregbuf;
 	UINT16 *srcreg;
 	UINT16 *dstreg;
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -1636,6 +1770,10 @@ void MMX_PSUBUSW(void)
 	}
 	dstreg = (UINT16*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_subs_epu16);
+#else
+	int i;
 	for(i=0;i<4;i++){
 		INT32 cbuf = (INT32)dstreg[i] - (INT32)srcreg[i];
 		if(cbuf > 65535){
@@ -1646,6 +1784,7 @@ void MMX_PSUBUSW(void)
 			dstreg[i] = (UINT16)cbuf;
 		}
 	}
+#endif
 }
 
 // *********** PUNPCK
@@ -1657,8 +1796,6 @@ void MMX_PUNPCKHBW(void)
 	MMXREG srcregbuf;
 	UINT8 *srcreg;
 	UINT8 *dstreg;
-	UINT8 dstregbuf[8];
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -1677,6 +1814,11 @@ void MMX_PUNPCKHBW(void)
 	}
 	dstreg = (UINT8*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, mmx_host_unpackhi_pi8);
+#else
+	UINT8 dstregbuf[8];
+	int i;
 	for(i=0;i<4;i++){
 		dstregbuf[i*2] = dstreg[i+4];
 		dstregbuf[i*2 + 1] = srcreg[i+4];
@@ -1684,6 +1826,7 @@ void MMX_PUNPCKHBW(void)
 	for(i=0;i<8;i++){
 		dstreg[i] = dstregbuf[i];
 	}
+#endif
 }
 void MMX_PUNPCKHWD(void)
 {
@@ -1692,8 +1835,6 @@ void MMX_PUNPCKHWD(void)
 	MMXREG srcregbuf;
 	UINT16 *srcreg;
 	UINT16 *dstreg;
-	UINT16 dstregbuf[4];
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -1712,6 +1853,11 @@ void MMX_PUNPCKHWD(void)
 	}
 	dstreg = (UINT16*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, mmx_host_unpackhi_pi16);
+#else
+	UINT16 dstregbuf[4];
+	int i;
 	for(i=0;i<2;i++){
 		dstregbuf[i*2] = dstreg[i+2];
 		dstregbuf[i*2 + 1] = srcreg[i+2];
@@ -1719,6 +1865,7 @@ void MMX_PUNPCKHWD(void)
 	for(i=0;i<4;i++){
 		dstreg[i] = dstregbuf[i];
 	}
+#endif
 }
 void MMX_PUNPCKHDQ(void)
 {
@@ -1758,8 +1905,6 @@ void MMX_PUNPCKLBW(void)
 	MMXREG srcregbuf;
 	UINT8 *srcreg;
 	UINT8 *dstreg;
-	UINT8 dstregbuf[8];
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -1778,6 +1923,11 @@ void MMX_PUNPCKLBW(void)
 	}
 	dstreg = (UINT8*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_unpacklo_epi8);
+#else
+	UINT8 dstregbuf[8];
+	int i;
 	for(i=0;i<4;i++){
 		dstregbuf[i*2] = dstreg[i];
 		dstregbuf[i*2 + 1] = srcreg[i];
@@ -1785,6 +1935,7 @@ void MMX_PUNPCKLBW(void)
 	for(i=0;i<8;i++){
 		dstreg[i] = dstregbuf[i];
 	}
+#endif
 }
 void MMX_PUNPCKLWD(void)
 {
@@ -1793,8 +1944,6 @@ void MMX_PUNPCKLWD(void)
 	MMXREG srcregbuf;
 	UINT16 *srcreg;
 	UINT16 *dstreg;
-	UINT16 dstregbuf[4];
-	int i;
 	
 	MMX_check_NM_EXCEPTION();
 	MMX_setTag();
@@ -1813,6 +1962,11 @@ void MMX_PUNPCKLWD(void)
 	}
 	dstreg = (UINT16*)(&(FPU_STAT.reg[idx]));
 	
+#if defined(USE_HOST_SSE2)
+	MMX_HOST_OP(dstreg, srcreg, _mm_unpacklo_epi16);
+#else
+	UINT16 dstregbuf[4];
+	int i;
 	for(i=0;i<2;i++){
 		dstregbuf[i*2] = dstreg[i];
 		dstregbuf[i*2 + 1] = srcreg[i];
@@ -1820,6 +1974,7 @@ void MMX_PUNPCKLWD(void)
 	for(i=0;i<4;i++){
 		dstreg[i] = dstregbuf[i];
 	}
+#endif
 }
 void MMX_PUNPCKLDQ(void)
 {
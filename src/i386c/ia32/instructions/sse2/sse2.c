@@ -64,6 +64,17 @@ static void trace_fmt_ex(const char *fmt, ...)
 
 #define CPU_SSE2WORKCLOCK	CPU_WORKCLOCK(2)
 
+#if defined(USE_HOST_SSE2)
+#include <emmintrin.h>
+
+// xmm/m128 -> xmm をホストのSSE2命令1つで処理する
+#define SSE2_HOST_PI3(dst, src1, src2, func) \
+	_mm_storeu_si128((__m128i*)(dst), func(_mm_loadu_si128((const __m128i*)(src1)), _mm_loadu_si128((const __m128i*)(src2))))
+#define SSE2_HOST_PI(data1, data2, func)	SSE2_HOST_PI3(data1, data1, data2, func)
+#define SSE2_HOST_PD(data1, data2, func) \
+	_mm_storeu_pd((data1), func(_mm_loadu_pd(data1), _mm_loadu_pd(data2)))
+#endif
+
 static INLINE void
 SSE2_check_NM_EXCEPTION(){
 	// SSE2なしならUD(無効オペコード例外)を発生させる
@@ -381,12 +392,16 @@ void SSE2_ADDPD(void)
 {
 	double data2buf[2];
 	double *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD(&data1, &data2, data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PD(data1, data2, _mm_add_pd);
+#else
+	int i;
 	for(i=0;i<2;i++){
 		data1[i] = data1[i] + data2[i];
 	}
+#endif
 	TRACEOUT(("SSE2_ADDPD"));
 }
 void SSE2_ADDSD(void)
@@ -731,12 +746,16 @@ void SSE2_DIVPD(void)
 {
 	double data2buf[2];
 	double *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD(&data1, &data2, data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PD(data1, data2, _mm_div_pd);
+#else
+	int i;
 	for(i=0;i<2;i++){
 		data1[i] = data1[i] / data2[i];
 	}
+#endif
 	TRACEOUT(("SSE2_DIVPD"));
 }
 void SSE2_DIVSD(void)
@@ -922,12 +941,16 @@ void SSE2_MULPD(void)
 {
 	double data2buf[2];
 	double *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD(&data1, &data2, data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PD(data1, data2, _mm_mul_pd);
+#else
+	int i;
 	for(i=0;i<2;i++){
 		data1[i] = data1[i] * data2[i];
 	}
+#endif
 	TRACEOUT(("SSE2_MULPD"));
 }
 void SSE2_MULSD(void)
@@ -968,12 +991,16 @@ void SSE2_SQRTPD(void)
 {
 	double data2buf[2];
 	double *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD(&data1, &data2, data2buf);
+#if defined(USE_HOST_SSE2)
+	_mm_storeu_pd(data1, _mm_sqrt_pd(_mm_loadu_pd(data2)));
+#else
+	int i;
 	for(i=0;i<2;i++){
 		data1[i] = sqrt(data2[i]);
 	}
+#endif
 	TRACEOUT(("SSE2_SQRTPD"));
 }
 void SSE2_SQRTSD(void)
@@ -993,12 +1020,16 @@ void SSE2_SUBPD(void)
 {
 	double data2buf[2];
 	double *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD(&data1, &data2, data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PD(data1, data2, _mm_sub_pd);
+#else
+	int i;
 	for(i=0;i<2;i++){
 		data1[i] = data1[i] - data2[i];
 	}
+#endif
 	TRACEOUT(("SSE2_SUBPD"));
 }
 void SSE2_SUBSD(void)
@@ -1201,8 +1232,6 @@ void SSE2_PACKSSDW(void)
 	INT32 *srcreg1;
 	INT32 *srcreg2;
 	INT16 *dstreg;
-	INT16 dstregbuf[8];
-	int i;
 	
 	SSE2_check_NM_EXCEPTION();
 	SSE2_setTag();
@@ -1225,6 +1254,11 @@ void SSE2_PACKSSDW(void)
 		srcreg2 = srcreg2buf.d;
 		dstreg = (INT16*)(&(FPU_STAT.xmm_reg[idx]));
 	}
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI3(dstreg, srcreg1, srcreg2, _mm_packs_epi32);
+#else
+	INT16 dstregbuf[8];
+	int i;
 	for(i=0;i<4;i++){
 		if(srcreg1[i] > 32767){
 			dstregbuf[i] = 32767;
@@ -1246,6 +1280,7 @@ void SSE2_PACKSSDW(void)
 	for(i=0;i<8;i++){
 		dstreg[i] = dstregbuf[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PACKSSDW"));
 }
 void SSE2_PACKSSWB(void)
@@ -1256,8 +1291,6 @@ void SSE2_PACKSSWB(void)
 	INT16 *srcreg1;
 	INT16 *srcreg2;
 	INT8 *dstreg;
-	INT8 dstregbuf[16];
-	int i;
 	
 	SSE2_check_NM_EXCEPTION();
 	SSE2_setTag();
@@ -1280,6 +1313,11 @@ void SSE2_PACKSSWB(void)
 		srcreg2 = srcreg2buf.w;
 		dstreg = (INT8*)(&(FPU_STAT.xmm_reg[idx]));
 	}
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI3(dstreg, srcreg1, srcreg2, _mm_packs_epi16);
+#else
+	INT8 dstregbuf[16];
+	int i;
 	for(i=0;i<8;i++){
 		if(srcreg1[i] > 127){
 			dstregbuf[i] = 127;
@@ -1301,6 +1339,7 @@ void SSE2_PACKSSWB(void)
 	for(i=0;i<16;i++){
 		dstreg[i] = dstregbuf[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PACKSSWB"));
 }
 void SSE2_PACKUSWB(void)
@@ -1311,8 +1350,6 @@ void SSE2_PACKUSWB(void)
 	INT16 *srcreg1;
 	INT16 *srcreg2;
 	UINT8 *dstreg;
-	UINT8 dstregbuf[16];
-	int i;
 	
 	SSE2_check_NM_EXCEPTION();
 	SSE2_setTag();
@@ -1335,6 +1372,11 @@ void SSE2_PACKUSWB(void)
 		srcreg2 = srcreg2buf.w;
 		dstreg = (UINT8*)(&(FPU_STAT.xmm_reg[idx]));
 	}
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI3(dstreg, srcreg1, srcreg2, _mm_packus_epi16);
+#else
+	UINT8 dstregbuf[16];
+	int i;
 	for(i=0;i<8;i++){
 		if(srcreg1[i] > 255){
 			dstregbuf[i] = 255;
@@ -1356,6 +1398,7 @@ void SSE2_PACKUSWB(void)
 	for(i=0;i<16;i++){
 		dstreg[i] = dstregbuf[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PACKUSWB"));
 }
 void SSE2_PADDQmm(void)
@@ -1383,48 +1426,64 @@ void SSE2_PADDQxmm(void)
 {
 	UINT64 data2buf[2];
 	UINT64 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64(&data1, &data2, data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_add_epi64);
+#else
+	int i;
 	for(i=0;i<2;i++){
 		data1[i] = data1[i] + data2[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PADDQxmm"));
 }
 void SSE2_PADDB(void)
 {
 	UINT8 data2buf[16];
 	UINT8 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_add_epi8);
+#else
+	int i;
 	for(i=0;i<16;i++){
 		data1[i] = data1[i] + data2[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PADDB"));
 }
 void SSE2_PADDW(void)
 {
 	UINT16 data2buf[8];
 	UINT16 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_add_epi16);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		data1[i] = data1[i] + data2[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PADDW"));
 }
 void SSE2_PADDD(void)
 {
 	UINT32 data2buf[4];
 	UINT32 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_add_epi32);
+#else
+	int i;
 	for(i=0;i<4;i++){
 		data1[i] = data1[i] + data2[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PADDD"));
 }
 //void SSE2_PADDQ(void)
@@ -1435,9 +1494,12 @@ void SSE2_PADDSB(void)
 {
 	SINT8 data2buf[16];
 	SINT8 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_adds_epi8);
+#else
+	int i;
 	for(i=0;i<16;i++){
 		SINT16 cbuf = (SINT16)data1[i] + (SINT16)data2[i];
 		if(cbuf > 127){
@@ -1448,15 +1510,19 @@ void SSE2_PADDSB(void)
 			data1[i] = (SINT8)cbuf;
 		}
 	}
+#endif
 	TRACEOUT(("SSE2_PADDSB"));
 }
 void SSE2_PADDSW(void)
 {
 	SINT16 data2buf[8];
 	SINT16 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_adds_epi16);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		SINT32 cbuf = (SINT32)data1[i] + (SINT32)data2[i];
 		if(cbuf > 32767){
@@ -1467,6 +1533,7 @@ void SSE2_PADDSW(void)
 			data1[i] = (SINT16)cbuf;
 		}
 	}
+#endif
 	TRACEOUT(("SSE2_PADDSW"));
 }
 //void SSE2_PADDSD(void)
@@ -1481,9 +1548,12 @@ void SSE2_PADDUSB(void)
 {
 	UINT8 data2buf[16];
 	UINT8 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_adds_epu8);
+#else
+	int i;
 	for(i=0;i<16;i++){
 		UINT16 cbuf = (UINT16)data1[i] + (UINT16)data2[i];
 		if(cbuf > 255){
@@ -1492,15 +1562,19 @@ void SSE2_PADDUSB(void)
 			data1[i] = (UINT8)cbuf;
 		}
 	}
+#endif
 	TRACEOUT(("SSE2_PADDUSB"));
 }
 void SSE2_PADDUSW(void)
 {
 	UINT16 data2buf[8];
 	UINT16 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_adds_epu16);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		UINT32 cbuf = (UINT32)data1[i] + (UINT32)data2[i];
 		if(cbuf > 65535){
@@ -1509,6 +1583,7 @@ void SSE2_PADDUSW(void)
 			data1[i] = (UINT16)cbuf;
 		}
 	}
+#endif
 	TRACEOUT(("SSE2_PADDUSW"));
 }
 //void SSE2_PADDUSD(void)
@@ -1533,60 +1608,80 @@ void SSE2_PAVGB(void)
 {
 	UINT8 data2buf[16];
 	UINT8 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_avg_epu8);
+#else
+	int i;
 	for(i=0;i<16;i++){
 		data1[i] = (UINT8)(((UINT16)data1[i] + (UINT16)data2[i] + 1) / 2);
 	}
+#endif
 	TRACEOUT(("SSE2_PAVGB"));
 }
 void SSE2_PAVGW(void)
 {
 	UINT16 data2buf[8];
 	UINT16 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_avg_epu16);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		data1[i] = (UINT16)(((UINT32)data1[i] + (UINT32)data2[i] + 1) / 2);
 	}
+#endif
 	TRACEOUT(("SSE2_PAVGW"));
 }
 void SSE2_PCMPEQB(void)
 {
 	UINT8 data2buf[16];
 	UINT8 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_cmpeq_epi8);
+#else
+	int i;
 	for(i=0;i<16;i++){
 		data1[i] = (data1[i] == data2[i] ? 0xff : 0x00);
 	}
+#endif
 	TRACEOUT(("SSE2_PCMPEQB"));
 }
 void SSE2_PCMPEQW(void)
 {
 	UINT16 data2buf[8];
 	UINT16 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_cmpeq_epi16);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		data1[i] = (data1[i] == data2[i] ? 0xffff : 0x00);
 	}
+#endif
 	TRACEOUT(("SSE2_PCMPEQW"));
 }
 void SSE2_PCMPEQD(void)
 {
 	UINT32 data2buf[4];
 	UINT32 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_cmpeq_epi32);
+#else
+	int i;
 	for(i=0;i<4;i++){
 		data1[i] = (data1[i] == data2[i] ? 0xffffffff : 0x00);
 	}
+#endif
 	TRACEOUT(("SSE2_PCMPEQD"));
 }
 //void SSE2_PCMPEQQ(void)
@@ -1597,36 +1692,48 @@ void SSE2_PCMPGTB(void)
 {
 	SINT8 data2buf[16];
 	SINT8 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_cmpgt_epi8);
+#else
+	int i;
 	for(i=0;i<16;i++){
 		data1[i] = (data1[i] > data2[i] ? 0xff : 0x00);
 	}
+#endif
 	TRACEOUT(("SSE2_PCMPGTB"));
 }
 void SSE2_PCMPGTW(void)
 {
 	SINT16 data2buf[8];
 	SINT16 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_cmpgt_epi16);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		data1[i] = (data1[i] > data2[i] ? 0xffff : 0x00);
 	}
+#endif
 	TRACEOUT(("SSE2_PCMPGTW"));
 }
 void SSE2_PCMPGTD(void)
 {
 	SINT32 data2buf[4];
 	SINT32 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_cmpgt_epi32);
+#else
+	int i;
 	for(i=0;i<4;i++){
 		data1[i] = (data1[i] > data2[i] ? 0xffffffff : 0x00);
 	}
+#endif
 	TRACEOUT(("SSE2_PCMPGTD"));
 }
 //void SSE2_PCMPGTQ(void)
@@ -1707,48 +1814,64 @@ void SSE2_PMAXSW(void)
 {
 	SINT16 data2buf[8];
 	SINT16 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_max_epi16);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		data1[i] = (data1[i] > data2[i] ? data1[i] : data2[i]);
 	}
+#endif
 	TRACEOUT(("SSE2_PMAXSW"));
 }
 void SSE2_PMAXUB(void)
 {
 	UINT8 data2buf[16];
 	UINT8 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_max_epu8);
+#else
+	int i;
 	for(i=0;i<16;i++){
 		data1[i] = (data1[i] > data2[i] ? data1[i] : data2[i]);
 	}
+#endif
 	TRACEOUT(("SSE2_PMAXUB"));
 }
 void SSE2_PMINSW(void)
 {
 	SINT16 data2buf[8];
 	SINT16 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_min_epi16);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		data1[i] = (data1[i] < data2[i] ? data1[i] : data2[i]);
 	}
+#endif
 	TRACEOUT(("SSE2_PMINSW"));
 }
 void SSE2_PMINUB(void)
 {
 	UINT8 data2buf[16];
 	UINT8 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_min_epu8);
+#else
+	int i;
 	for(i=0;i<16;i++){
 		data1[i] = (data1[i] < data2[i] ? data1[i] : data2[i]);
 	}
+#endif
 	TRACEOUT(("SSE2_PMINUB"));
 }
 void SSE2_PMOVMSKB(void)
@@ -1794,7 +1917,6 @@ void SSE2_PMULHUW(void)
 	UINT idx, sub;
 	SSEREG data2buf;
 	UINT16 *data1, *data2;
-	int i;
 	
 	SSE2_check_NM_EXCEPTION();
 	SSE2_setTag();
@@ -1814,9 +1936,14 @@ void SSE2_PMULHUW(void)
 		data2buf.d[3] = cpu_vmemoryread_d(CPU_INST_SEGREG_INDEX, maddr + 12);
 		data2 = data2buf.w;
 	}
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_mulhi_epu16);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		data1[i] = (UINT16)((((UINT32)data2[i] * (UINT32)data1[i]) >> 16) & 0xffff);
 	}
+#endif
 	TRACEOUT(("SSE2_PMULHUW"));
 }
 void SSE2_PMULHW(void)
@@ -1825,7 +1952,6 @@ void SSE2_PMULHW(void)
 	UINT idx, sub;
 	SSEREG data2buf;
 	SINT16 *data1, *data2;
-	int i;
 	
 	SSE2_check_NM_EXCEPTION();
 	SSE2_setTag();
@@ -1845,9 +1971,14 @@ void SSE2_PMULHW(void)
 		data2buf.d[3] = cpu_vmemoryread_d(CPU_INST_SEGREG_INDEX, maddr + 12);
 		data2 = data2buf.w;
 	}
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_mulhi_epi16);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		data1[i] = (SINT16)((((SINT32)data2[i] * (SINT32)data1[i]) >> 16) & 0xffff);
 	}
+#endif
 	TRACEOUT(("SSE2_PMULHW"));
 }
 void SSE2_PMULLW(void)
@@ -1856,7 +1987,6 @@ void SSE2_PMULLW(void)
 	UINT idx, sub;
 	SSEREG data2buf;
 	SINT16 *data1, *data2;
-	int i;
 	
 	SSE2_check_NM_EXCEPTION();
 	SSE2_setTag();
@@ -1876,9 +2006,14 @@ void SSE2_PMULLW(void)
 		data2buf.d[3] = cpu_vmemoryread_d(CPU_INST_SEGREG_INDEX, maddr + 12);
 		data2 = data2buf.w;
 	}
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_mullo_epi16);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		data1[i] = (SINT16)((((SINT32)data2[i] * (SINT32)data1[i])) & 0xffff);
 	}
+#endif
 	TRACEOUT(("SSE2_PMULLW"));
 }
 void SSE2_PMULUDQmm(void)
@@ -1906,12 +2041,16 @@ void SSE2_PMULUDQxmm(void)
 {
 	UINT64 data2buf[2];
 	UINT64 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64(&data1, &data2, data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_mul_epu32);
+#else
+	int i;
 	for(i=0;i<2;i++){
 		data1[i] = (data1[i] & 0xffffffff) * (data2[i] & 0xffffffff);
 	}
+#endif
 	TRACEOUT(("SSE2_PMULUDQxmm"));
 }
 void SSE2_POR(void)
@@ -2442,48 +2581,64 @@ void SSE2_PSUBQxmm(void)
 {
 	UINT64 data2buf[2];
 	UINT64 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64(&data1, &data2, data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_sub_epi64);
+#else
+	int i;
 	for(i=0;i<2;i++){
 		data1[i] = data1[i] - data2[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PSUBQxmm"));
 }
 void SSE2_PSUBB(void)
 {
 	UINT8 data2buf[16];
 	UINT8 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_sub_epi8);
+#else
+	int i;
 	for(i=0;i<16;i++){
 		data1[i] = data1[i] - data2[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PSUBB"));
 }
 void SSE2_PSUBW(void)
 {
 	UINT16 data2buf[8];
 	UINT16 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_sub_epi16);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		data1[i] = data1[i] - data2[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PSUBW"));
 }
 void SSE2_PSUBD(void)
 {
 	UINT32 data2buf[4];
 	UINT32 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_sub_epi32);
+#else
+	int i;
 	for(i=0;i<4;i++){
 		data1[i] = data1[i] - data2[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PSUBD"));
 }
 //void SSE2_PSUBQ(void)
@@ -2494,9 +2649,12 @@ void SSE2_PSUBSB(void)
 {
 	SINT8 data2buf[16];
 	SINT8 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_subs_epi8);
+#else
+	int i;
 	for(i=0;i<16;i++){
 		SINT16 cbuf = (SINT16)data1[i] - (SINT16)data2[i];
 		if(cbuf > 127){
@@ -2507,15 +2665,19 @@ void SSE2_PSUBSB(void)
 			data1[i] = (SINT8)cbuf;
 		}
 	}
+#endif
 	TRACEOUT(("SSE2_PSUBSB"));
 }
 void SSE2_PSUBSW(void)
 {
 	SINT16 data2buf[8];
 	SINT16 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_subs_epi16);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		SINT32 cbuf = (SINT32)data1[i] - (SINT32)data2[i];
 		if(cbuf > 32767){
@@ -2526,6 +2688,7 @@ void SSE2_PSUBSW(void)
 			data1[i] = (SINT16)cbuf;
 		}
 	}
+#endif
 	TRACEOUT(("SSE2_PSUBSW"));
 }
 //void SSE2_PSUBSD(void)
@@ -2540,9 +2703,12 @@ void SSE2_PSUBUSB(void)
 {
 	UINT8 data2buf[16];
 	UINT8 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_subs_epu8);
+#else
+	int i;
 	for(i=0;i<16;i++){
 		SINT16 cbuf = (SINT16)data1[i] - (SINT16)data2[i];
 		if(cbuf > 255){
@@ -2553,15 +2719,19 @@ void SSE2_PSUBUSB(void)
 			data1[i] = (UINT8)cbuf;
 		}
 	}
+#endif
 	TRACEOUT(("SSE2_PSUBUSB"));
 }
 void SSE2_PSUBUSW(void)
 {
 	UINT16 data2buf[8];
 	UINT16 *data1, *data2;
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_subs_epu16);
+#else
+	int i;
 	for(i=0;i<8;i++){
 		SINT32 cbuf = (SINT32)data1[i] - (SINT32)data2[i];
 		if(cbuf > 65535){
@@ -2572,6 +2742,7 @@ void SSE2_PSUBUSW(void)
 			data1[i] = (UINT16)cbuf;
 		}
 	}
+#endif
 	TRACEOUT(("SSE2_PSUBUSW"));
 }
 //void SSE2_PSUBUSD(void)
@@ -2587,11 +2758,14 @@ void SSE2_PUNPCKHBW(void)
 	UINT8 data2buf[16];
 	UINT8 *data1;
 	UINT8 *data2;
-	UINT8 dstregbuf[16];
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
 	
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_unpackhi_epi8);
+#else
+	UINT8 dstregbuf[16];
+	int i;
 	for(i=0;i<8;i++){
 		dstregbuf[i*2] = data1[i+8];
 		dstregbuf[i*2 + 1] = data2[i+8];
@@ -2599,6 +2773,7 @@ void SSE2_PUNPCKHBW(void)
 	for(i=0;i<16;i++){
 		data1[i] = dstregbuf[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PUNPCKHBW"));
 }
 void SSE2_PUNPCKHWD(void)
@@ -2606,11 +2781,14 @@ void SSE2_PUNPCKHWD(void)
 	UINT16 data2buf[8];
 	UINT16 *data1;
 	UINT16 *data2;
-	UINT16 dstregbuf[8];
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
 	
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_unpackhi_epi16);
+#else
+	UINT16 dstregbuf[8];
+	int i;
 	for(i=0;i<4;i++){
 		dstregbuf[i*2] = data1[i+4];
 		dstregbuf[i*2 + 1] = data2[i+4];
@@ -2618,6 +2796,7 @@ void SSE2_PUNPCKHWD(void)
 	for(i=0;i<8;i++){
 		data1[i] = dstregbuf[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PUNPCKHWD"));
 }
 void SSE2_PUNPCKHDQ(void)
@@ -2625,11 +2804,14 @@ void SSE2_PUNPCKHDQ(void)
 	UINT32 data2buf[4];
 	UINT32 *data1;
 	UINT32 *data2;
-	UINT32 dstregbuf[4];
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
 	
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_unpackhi_epi32);
+#else
+	UINT32 dstregbuf[4];
+	int i;
 	for(i=0;i<2;i++){
 		dstregbuf[i*2] = data1[i+2];
 		dstregbuf[i*2 + 1] = data2[i+2];
@@ -2637,6 +2819,7 @@ void SSE2_PUNPCKHDQ(void)
 	for(i=0;i<4;i++){
 		data1[i] = dstregbuf[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PUNPCKHDQ"));
 }
 void SSE2_PUNPCKHQDQ(void)
@@ -2659,11 +2842,14 @@ void SSE2_PUNPCKLBW(void)
 	UINT8 data2buf[16];
 	UINT8 *data1;
 	UINT8 *data2;
-	UINT8 dstregbuf[16];
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
 	
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_unpacklo_epi8);
+#else
+	UINT8 dstregbuf[16];
+	int i;
 	for(i=0;i<8;i++){
 		dstregbuf[i*2] = data1[i];
 		dstregbuf[i*2 + 1] = data2[i];
@@ -2671,6 +2857,7 @@ void SSE2_PUNPCKLBW(void)
 	for(i=0;i<16;i++){
 		data1[i] = dstregbuf[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PUNPCKLBW"));
 }
 void SSE2_PUNPCKLWD(void)
@@ -2678,11 +2865,14 @@ void SSE2_PUNPCKLWD(void)
 	UINT16 data2buf[8];
 	UINT16 *data1;
 	UINT16 *data2;
-	UINT16 dstregbuf[8];
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
 	
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_unpacklo_epi16);
+#else
+	UINT16 dstregbuf[8];
+	int i;
 	for(i=0;i<4;i++){
 		dstregbuf[i*2] = data1[i];
 		dstregbuf[i*2 + 1] = data2[i];
@@ -2690,6 +2880,7 @@ void SSE2_PUNPCKLWD(void)
 	for(i=0;i<8;i++){
 		data1[i] = dstregbuf[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PUNPCKLWD"));
 }
 void SSE2_PUNPCKLDQ(void)
@@ -2697,11 +2888,14 @@ void SSE2_PUNPCKLDQ(void)
 	UINT32 data2buf[4];
 	UINT32 *data1;
 	UINT32 *data2;
-	UINT32 dstregbuf[4];
-	int i;
 	
 	SSE_PART_GETDATA1DATA2_PD_UINT64((UINT64**)(&data1), (UINT64**)(&data2), (UINT64*)data2buf);
 	
+#if defined(USE_HOST_SSE2)
+	SSE2_HOST_PI(data1, data2, _mm_unpacklo_epi32);
+#else
+	UINT32 dstregbuf[4];
+	int i;
 	for(i=0;i<2;i++){
 		dstregbuf[i*2] = data1[i];
 		dstregbuf[i*2 + 1] = data2[i];
@@ -2709,6 +2903,7 @@ void SSE2_PUNPCKLDQ(void)
 	for(i=0;i<4;i++){
 		data1[i] = dstregbuf[i];
 	}
+#endif
 	TRACEOUT(("SSE2_PUNPCKLDQ"));
 }
 void SSE2_PUNPCKLQDQ(void)
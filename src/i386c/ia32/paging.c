@@ -825,6 +825,7 @@ void
 tlb_init(void)
 {
 	memset(tlb, 0, sizeof(tlb));
+	cpu_codefetch_flush();
 }
 
 void MEMCALL
@@ -842,6 +843,7 @@ tlb_flush()
 			}
 		}
 	}
+	cpu_codefetch_flush();
 }
 
 void MEMCALL
@@ -867,6 +869,7 @@ tlb_flush_page(UINT32 laddr)
 			}
 		}
 	}
+	cpu_codefetch_flush();
 }
 
 struct tlb_entry * MEMCALL
@@ -145,6 +145,7 @@ load_cs(UINT16 selector, const descriptor_t *sdp, int new_cpl)
 	CPU_CS = (UINT16)((selector & ~3) | cpl);
 	CPU_CS_DESC = *sdp;
 	set_cpl(cpl);
+	cpu_codefetch_flush();
 }
 
 /*
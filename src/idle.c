@@ -0,0 +1,151 @@
+#include "idle.h"
+#include "dbg.h"
+#include "emu.h"
+#include "env.h"
+#include "keyb.h"
+#include "pic.h"
+#include "timer.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <time.h>
+
+// Number of unsuccessful polls in one timer tick before going to sleep.
+#define MAX_IDLE_POLLS 256
+
+static int idle_disabled = -1;
+static int input_fd = -1;
+static int poll_count = 0;
+
+unsigned idle_mem_changes;
+unsigned idle_polls;
+
+// Guest state at the previous poll
+#define POLL_REGS 13
+static struct
+{
+    uint32_t regs[POLL_REGS];
+    unsigned mem_changes;
+} last_poll;
+
+// Returns 1 if the registers are the same as on the previous poll.
+static int poll_regs_same(void)
+{
+#ifdef IA32
+    uint32_t regs[POLL_REGS] = {
+        cpuGetEAX(), cpuGetEBX(), cpuGetECX(), cpuGetEDX(), cpuGetESI(),
+        cpuGetEDI(), cpuGetEBP(), cpuGetESP(), cpuGetEIP(), cpuGetCS(),
+        cpuGetDS(),  cpuGetES(),  cpuGetSS()};
+#else
+    uint32_t regs[POLL_REGS] = {
+        cpuGetAX(), cpuGetBX(), cpuGetCX(), cpuGetDX(), cpuGetSI(),
+        cpuGetDI(), cpuGetBP(), cpuGetSP(), cpuGetIP(), cpuGetCS(),
+        cpuGetDS(), cpuGetES(), cpuGetSS()};
+#endif
+    if(!memcmp(last_poll.regs, regs, sizeof(regs)))
+        return 1;
+    memcpy(last_poll.regs, regs, sizeof(regs));
+    return 0;
+}
+
+void idle_set_input(int fd)
+{
+    input_fd = fd;
+}
+
+void idle_activity(void)
+{
+    poll_count = 0;
+}
+
+void idle_tick(void)
+{
+    poll_count = 0;
+}
+
+// Sleeps until the timer signal arrives or there is input, returns 1 on input.
+int idle_wait(void)
+{
+    sigset_t alrm, orig;
+    int ret = 0;
+
+    // Block SIGALRM while checking "exit_cpu", pselect() unblocks it
+    // atomically, so a tick can't be lost between the check and the sleep.
+    sigemptyset(&alrm);
+    sigaddset(&alrm, SIGALRM);
+    sigprocmask(SIG_BLOCK, &alrm, &orig);
+    if(!exit_cpu)
+    {
+        // Wait at most one tick, in case the timer signal is not running.
+        struct timespec ts = {0, 54925000};
+        fd_set rd;
+        FD_ZERO(&rd);
+        if(input_fd >= 0)
+            FD_SET(input_fd, &rd);
+        debug(debug_int, "idle: sleep.\n");
+        int n = pselect(input_fd + 1, &rd, 0, 0, &ts, &orig);
+        if(n > 0 && input_fd >= 0 && FD_ISSET(input_fd, &rd))
+            ret = 1;
+        else if(n == 0 && timer_is_virtual())
+            exit_cpu = 1; // There is no timer signal, emulate the tick
+        else if(n < 0 && errno != EINTR)
+            debug(debug_int, "idle: pselect error %d\n", errno);
+    }
+    sigprocmask(SIG_SETMASK, &orig, 0);
+    return ret;
+}
+
+void idle_poll(void)
+{
+    idle_polls++;
+    if(idle_disabled < 0)
+        idle_disabled = getenv(ENV_NOIDLE) != 0;
+    if(idle_disabled)
+        return;
+    // Writing to memory between polls is real work, not waiting. A change
+    // only in the registers (a counter, the value just polled) is not
+    // counted as an idle poll either.
+    if(last_poll.mem_changes != idle_mem_changes)
+    {
+        last_poll.mem_changes = idle_mem_changes;
+        poll_count = 0;
+    }
+    if(!poll_regs_same() || ++poll_count <= MAX_IDLE_POLLS)
+        return;
+
+    // With virtual time, skip to the next tick instead of waiting for it
+    if(timer_is_virtual())
+    {
+        exit_cpu = 1;
+        return;
+    }
+
+    if(idle_wait())
+    {
+        // Pass the key to the guest now instead of waiting for the next tick
+        poll_count = 0;
+        update_keyb();
+    }
+}
+
+void idle_halt(void)
+{
+    // A masked request can't wake up the CPU, wait for the next tick
+    if(timer_is_virtual())
+    {
+        if(!pic_irq_unmasked())
+            exit_cpu = 1;
+        return;
+    }
+    while(!exit_cpu && !pic_irq_unmasked())
+    {
+        if(idle_wait())
+        {
+            update_keyb();
+            break;
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// Idle detection: when the guest busy-waits (polling the keyboard, the CGA
+// status port, the BIOS tick...) the host sleeps until the next timer tick
+// or terminal input instead of spinning.
+
+// The guest polled for an event that was not there, only counted if the
+// registers and memory are the same as on the previous poll.
+void idle_poll(void);
+// Number of idle_poll() calls, so that the loop detectors of the CPU cores
+// can leave alone the loops that already poll through the BIOS or a port.
+extern unsigned idle_polls;
+// Incremented by the CPU on guest memory writes: the 8086 core counts all
+// writes but the stack pushes, the IA-32 core the writes changing memory.
+extern unsigned idle_mem_changes;
+// The guest did useful work (output, etc.), don't consider it idle.
+void idle_activity(void);
+// Called on each emulated timer tick.
+void idle_tick(void);
+// File descriptor that wakes the emulator when readable.
+void idle_set_input(int fd);
+// Sleeps until the next timer tick or input, returns 1 on input.
+int idle_wait(void);
+// Guest HLT: sleeps until an interrupt request is pending.
+void idle_halt(void);
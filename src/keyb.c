@@ -2,26 +2,49 @@
 #include "codepage.h"
 #include "dbg.h"
 #include "emu.h"
+#include "env.h"
 #include "os.h"
 #include "extmem.h"
+#include "idle.h"
+#include "video.h"
 
 #include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
 #include <termios.h>
 #include <unistd.h>
 
-#define MAX_KEYB_CALLS 10
+static void init_keyboard(void);
 
 static int term_raw = 0;
 static int tty_fd = -1;
 static int queued_key = -1;
 static int waiting_key = 0;
 static int mod_state = 0;
-static int throttle_calls = 0;
+
+// Terminal input, read in blocks to use only one system call per burst.
+static uint8_t input_buf[256];
+static unsigned input_pos, input_len;
+
+// Input script, typed before reading the terminal.
+static int script_loaded = 0;
+static uint8_t *script;
+static unsigned script_pos, script_len;
+static uint8_t wait_text[256];
+static unsigned wait_len;
+// Last output written while the video emulation is off, searched by the
+// "\w{text}" waits when there is no screen.
+static uint8_t con_text[2 * sizeof(wait_text)];
+static unsigned con_len;
+
+// Decoded keys not yet passed to the emulated keyboard, with the modifiers
+// stored in the upper bits.
+#define KEY_QUEUE_SIZE 16
+static int key_queue[KEY_QUEUE_SIZE];
+static unsigned key_queue_pos, key_queue_len;
 
 // Copy mod-state to BIOS memory area
 static void update_bios_state(void)
@@ -226,6 +249,199 @@ static int alt_char(int i)
     return add_scancode(i) & 0xFF00; // No ASCII code on ALT+char
 }
 
+static void load_script(void)
+{
+    const char *fname = getenv(ENV_KEYS);
+    script_loaded = 1;
+    if(!fname || !*fname)
+        return;
+    FILE *f = fopen(fname, "rb");
+    if(!f)
+        print_error("can't open input script '%s': %s\n", fname, strerror(errno));
+    // Read in blocks, the script can be a pipe or a FIFO
+    unsigned size = 0, alloc = 0;
+    for(;;)
+    {
+        if(size == alloc)
+        {
+            alloc = alloc ? alloc * 2 : 4096;
+            script = realloc(script, alloc);
+            if(!script)
+                print_error("can't read input script '%s': out of memory\n", fname);
+        }
+        size_t n = fread(script + size, 1, alloc - size, f);
+        if(!n)
+            break;
+        size += n;
+    }
+    if(ferror(f))
+        print_error("can't read input script '%s'\n", fname);
+    fclose(f);
+    script_pos = 0;
+    script_len = size;
+    debug(debug_int, "keys: script '%s', %u bytes.\n", fname, size);
+}
+
+// Reads the text of a "\w{text}" command, converted to DOS characters
+static void script_wait_text(void)
+{
+    uint8_t utf8[sizeof(wait_text) + 4];
+    unsigned len = 0;
+    if(script_pos < script_len && script[script_pos] == '{')
+        script_pos++;
+    while(script_pos < script_len && script[script_pos] != '}')
+    {
+        uint8_t ch = script[script_pos++];
+        if(len < sizeof(wait_text))
+            utf8[len++] = ch;
+    }
+    script_pos++;
+    utf8[len] = 0;
+
+    const uint8_t *u = utf8;
+    wait_len = 0;
+    while(*u && wait_len < sizeof(wait_text) - 1)
+    {
+        int c1, c2;
+        if(get_dos_char(utf8_to_unicode(&u), &c1, &c2) == 2)
+            wait_text[wait_len++] = c1, c1 = c2;
+        wait_text[wait_len++] = c1;
+    }
+    debug(debug_int, "keys: waiting for '%s'.\n", utf8);
+}
+
+void keyb_console_output(const uint8_t *str, unsigned len)
+{
+    if(len >= sizeof(con_text))
+    {
+        str += len - sizeof(con_text);
+        len = sizeof(con_text);
+    }
+    if(con_len + len > sizeof(con_text))
+    {
+        unsigned drop = con_len + len - sizeof(con_text);
+        memmove(con_text, con_text + drop, con_len - drop);
+        con_len -= drop;
+    }
+    memcpy(con_text + con_len, str, len);
+    con_len += len;
+}
+
+// Searches the console output for the text, and removes the output up to
+// the match so that the next wait needs new output.
+static int console_find_text(const uint8_t *text, unsigned len)
+{
+    for(unsigned i = 0; i + len <= con_len; i++)
+        if(!memcmp(con_text + i, text, len))
+        {
+            con_len -= i + len;
+            memmove(con_text, con_text + i + len, con_len);
+            return 1;
+        }
+    return 0;
+}
+
+// Returns the next byte from the input script, -1 if waiting for text on
+// the screen or -2 at the end of the script.
+static int get_script_byte(void)
+{
+    if(wait_len)
+    {
+        if(video_active() ? !video_find_text(wait_text, wait_len)
+                          : !console_find_text(wait_text, wait_len))
+            return -1;
+        wait_len = 0;
+    }
+    while(script_pos < script_len)
+    {
+        uint8_t ch = script[script_pos++];
+        if(ch == '\r')
+            continue;
+        if(ch == '\n')
+            return 0x0D;
+        if(ch != '\\' || script_pos == script_len)
+            return ch;
+        ch = script[script_pos++];
+        switch(ch)
+        {
+        case '\n': continue; // Line continuation
+        case 'e':  return 0x1B;
+        case 'r':
+        case 'n':  return 0x0D;
+        case 't':  return 0x09;
+        case 'b':  return 0x7F; // Backspace, as sent by terminals
+        case 'x':
+        {
+            int val = 0;
+            for(int i = 0; i < 2 && script_pos < script_len; i++)
+            {
+                int c = script[script_pos];
+                if(c >= '0' && c <= '9')      c -= '0';
+                else if(c >= 'a' && c <= 'f') c -= 'a' - 10;
+                else if(c >= 'A' && c <= 'F') c -= 'A' - 10;
+                else                          break;
+                val = val * 16 + c;
+                script_pos++;
+            }
+            return val;
+        }
+        case 'w':
+            script_wait_text();
+            return get_script_byte();
+        default:   return ch;
+        }
+    }
+    return -2;
+}
+
+// Returns the next byte from the terminal, or -1 if there is no input.
+static int get_input_byte(void)
+{
+    if(input_pos == input_len)
+    {
+        if(script)
+        {
+            int ch = get_script_byte();
+            if(ch != -2)
+                return ch;
+            // Script finished, continue with the terminal
+            debug(debug_int, "keys: end of script.\n");
+            free(script);
+            script = 0;
+            init_keyboard();
+        }
+        ssize_t n = read(tty_fd, input_buf, sizeof(input_buf));
+        input_pos = 0;
+        input_len = n > 0 ? n : 0;
+        if(!input_len)
+            return -1;
+    }
+    return input_buf[input_pos++];
+}
+
+static int input_pending(void)
+{
+    return input_pos != input_len || key_queue_len != 0;
+}
+
+static void push_key(int key)
+{
+    if(key_queue_len < KEY_QUEUE_SIZE)
+    {
+        unsigned i = (key_queue_pos + key_queue_len++) % KEY_QUEUE_SIZE;
+        key_queue[i] = key | (mod_state << 16);
+    }
+}
+
+static int pop_key(void)
+{
+    int key = key_queue[key_queue_pos];
+    key_queue_pos = (key_queue_pos + 1) % KEY_QUEUE_SIZE;
+    key_queue_len--;
+    mod_state = key >> 16;
+    return key & 0xFFFF;
+}
+
 static int get_esc_secuence(void)
 {
     // Read and process ESC sequences:
@@ -234,8 +450,8 @@ static int get_esc_secuence(void)
     // ESC <number>                     ALT+number
     // ESC [ <modifiers> <letter>       Function Keys
     mod_state = 0;
-    char ch = '\xFF';
-    if(read(tty_fd, &ch, 1) == 0)
+    int ch = get_input_byte();
+    if(ch < 0)
         return 0x011B; // ESC
     if(ch != '[' && ch != 'O')
         return alt_char(ch);
@@ -243,8 +459,8 @@ static int get_esc_secuence(void)
     int n1 = 0, n2 = 0;
     while(1)
     {
-        char cn = '\xFF';
-        if(read(tty_fd, &cn, 1) == 0)
+        int cn = get_input_byte();
+        if(cn < 0)
         {
             if(n1 == 0 && n2 == 0)
                 return alt_char(ch); // it is an ALT+'[' or ALT+'O'
@@ -321,18 +537,39 @@ static int get_esc_secuence(void)
     }
 }
 
-static int read_key(void)
+// Converts an unicode character to a DOS key, queues the second byte of DBCS
+static int unicode_key(int uc)
 {
-    char ch = '\xFF';
-    static int prev_key;
+    int n, oc1, oc2;
+    n = get_dos_char(uc, &oc1, &oc2);
+    if(n == 0)
+        return -1;
+    if(n == 2)
+        push_key(oc2);
+    return oc1;
+}
 
-    if (prev_key) {
-        ch = prev_key;
-        prev_key = 0;
-        return ch;
+// Reads the continuation bytes of an UTF-8 sequence
+static int get_utf8(int uc, int len)
+{
+    while(len--)
+    {
+        int ch = get_input_byte();
+        if(ch < 0 || (ch & 0xC0) != 0x80)
+            return -1; // INVALID UTF-8
+        uc = (uc << 6) | (ch & 0x3F);
     }
+    return uc;
+}
+
+static int read_key(void)
+{
+    if(key_queue_len)
+        return pop_key();
+
     // Reads first key code
-    if(read(tty_fd, &ch, 1) == 0)
+    int ch = get_input_byte();
+    if(ch < 0)
         return -1; // No data
 
     // ESC + keys, terminal codes
@@ -341,56 +578,25 @@ static int read_key(void)
 
     mod_state = 0;
     // Normal key
-    if((ch & 0xFF) < 0x80)
+    if(ch < 0x80)
         return add_scancode(ch);
 
     // Unicode character, read rest of codes
+    int uc;
     if((ch & 0xE0) == 0xC0)
     {
-        char ch1 = '\xFF';
-        int n, oc1, oc2;
-        if(read(tty_fd, &ch1, 1) == 0 || (ch1 & 0xC0) != 0x80)
+        if((uc = get_utf8(ch & 0x1F, 1)) < 0)
             return 0; // INVALID UTF-8
-        n = get_dos_char(((ch & 0x1F) << 6) | (ch1 & 0x3F), &oc1, &oc2);
-        if (n == 0)
-            return -1;
-        if (n == 2)
-            prev_key = oc2;
-        return oc1;
     }
     else if((ch & 0xF0) == 0xE0)
-    {
-        char ch1 = '\xFF', ch2 = '\xFF';
-        int n, oc1, oc2;
-        if(read(tty_fd, &ch1, 1) == 0 || (ch1 & 0xC0) != 0x80 ||
-           read(tty_fd, &ch2, 1) == 0 || (ch2 & 0xC0) != 0x80)
-            return -1; // INVALID UTF-8
-        n = get_dos_char(((ch & 0x0F) << 12) | ((ch1 & 0x3F) << 6) | (ch2 & 0x3F), &oc1, &oc2);
-        if (n == 0)
-            return -1;
-        if (n == 2)
-            prev_key = oc2;
-        return oc1;
-    }
+        uc = get_utf8(ch & 0x0F, 2);
     else if((ch & 0xF8) == 0xF0)
-    {
-        char ch1 = '\xFF', ch2 = '\xFF', ch3 = '\xFF';
-        int n, oc1, oc2;
-        if(read(tty_fd, &ch1, 1) == 0 || (ch1 & 0xC0) != 0x80 ||
-           read(tty_fd, &ch2, 1) == 0 || (ch2 & 0xC0) != 0x80 ||
-           read(tty_fd, &ch3, 1) == 0 || (ch3 & 0xC0) != 0x80)
-            return -1; // INVALID UTF-8
-        n = get_dos_char(((ch & 0x07) << 18) | ((ch1 & 0x3F) << 12) |
-                         ((ch2 & 0x3F) << 6) | (ch3 & 0x3F),
-                         &oc1, &oc2);
-        if (n == 0)
-            return -1;
-        if (n == 2)
-            prev_key = oc2;
-        return oc1;
-    }
+        uc = get_utf8(ch & 0x07, 3);
     else
         return 0; // INVALID UTF-8
+    if(uc < 0)
+        return -1;
+    return unicode_key(uc);
 }
 
 static void set_raw_term(int raw)
@@ -430,16 +636,30 @@ static void exit_keyboard(void)
 
 static void init_keyboard(void)
 {
+    if(!script_loaded)
+        load_script();
+    if(script)
+        return;
     if(tty_fd < 0)
     {
         tty_fd = open("/dev/tty", O_NOCTTY | O_RDONLY);
         if(tty_fd < 0)
             print_error("error at open TTY, %s\n", strerror(errno));
         atexit(exit_keyboard);
+        idle_set_input(tty_fd);
     }
     set_raw_term(1);
 }
 
+BIOS_IRET(keyb_handle_irq)
+BIOS_IRET(intr16)
+
+void init_keyb(void)
+{
+    reg_bios_routine(0x09, keyb_handle_irq_iret); // Keyboard interrupt
+    reg_bios_routine(0x16, intr16_iret);
+}
+
 // Disables keyboard support - will be enabled again if needed
 void suspend_keyboard(void)
 {
@@ -447,11 +667,6 @@ void suspend_keyboard(void)
         set_raw_term(0);
 }
 
-void keyb_wakeup(void)
-{
-    throttle_calls = 0;
-}
-
 int kbhit(void)
 {
     if(queued_key == -1)
@@ -463,31 +678,6 @@ int kbhit(void)
             update_bios_state();
             cpuTriggerIRQ(1);
         }
-        else
-        {
-            // Used to throttle the CPU on a busy-loop waiting for keyboard
-            static double last_time;
-
-            struct timeval tv;
-            if(gettimeofday(&tv, NULL) != -1)
-            {
-                double t1 = tv.tv_usec + tv.tv_sec * 1000000.0;
-                // Arbitrary limit to 4 calls each 100Hz
-                if((t1 - last_time) < 10000)
-                {
-                    throttle_calls++;
-                    if(throttle_calls > MAX_KEYB_CALLS)
-                    {
-                        debug(debug_int, "keyboard sleep.\n");
-                        usleep(10000);
-                        throttle_calls = 0;
-                    }
-                }
-                else
-                    throttle_calls = 0;
-                last_time = t1;
-            }
-        }
     }
     return (queued_key == -1) ? 0 : queued_key;
 }
@@ -499,10 +689,15 @@ int getch(int detect_brk)
     {
         if(kbhit())
             break;
-        usleep(100000);
-        waiting_key = 1;
-        emulator_update();
-        waiting_key = 0;
+        // Sleep until input or the next timer tick, and keep the emulated
+        // hardware running on each tick.
+        if(!idle_wait() && exit_cpu)
+        {
+            exit_cpu = 0;
+            waiting_key = 1;
+            emulator_update();
+            waiting_key = 0;
+        }
     }
     if(detect_brk && ((queued_key & 0xFF) == 3))
         raise(SIGINT);
@@ -510,13 +705,16 @@ int getch(int detect_brk)
     queued_key = -1;
     keyb_read_buffer();
     update_bios_state();
+    // Pass the next buffered key now instead of waiting for the next tick
+    if(input_pending())
+        kbhit();
     return ret;
 }
 
 void update_keyb(void)
 {
     // See if any key is available:
-    if(tty_fd >= 0 && !waiting_key && queued_key == -1)
+    if((tty_fd >= 0 || script) && !waiting_key && queued_key == -1)
         kbhit();
 }
 
@@ -528,8 +726,8 @@ static int keyb_disable = 0;
 // Handle keyboard controller port reading
 uint8_t keyb_read_port(unsigned port)
 {
-    if(queued_key == -1)
-        kbhit();
+    if(queued_key == -1 && !kbhit())
+        idle_poll();
     debug(debug_int, "keyboard read_port: %02X (key=%04X)\n", port, 0xFFFFU & queued_key);
     if(port == 0x60)
     {
@@ -646,7 +844,10 @@ void intr16(void)
         ax = kbhit();
         cpuSetAX(ax);
         if(ax == 0)
+        {
+            idle_poll();
             cpuSetFlag(cpuFlag_ZF);
+        }
         else
             cpuClrFlag(cpuFlag_ZF);
         break;
@@ -1,6 +1,8 @@
 #pragma once
 #include <stdint.h>
 
+// Registers the keyboard interrupt handlers, the terminal is opened on first use.
+void init_keyb(void);
 void update_keyb(void);
 int getch(int detect_brk);
 int kbhit(void);
@@ -8,6 +10,6 @@ void intr16(void);
 uint8_t keyb_read_port(unsigned port);
 void keyb_write_port(unsigned port, uint8_t value);
 void suspend_keyboard(void);
-// Disable throttling the next keyboard calls
-void keyb_wakeup(void);
 void keyb_handle_irq(void);
+// Output to the standard handles while the video emulation is off.
+void keyb_console_output(const uint8_t *str, unsigned len);
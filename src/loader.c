@@ -6,6 +6,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // First MCB
 static uint16_t mcb_start = 0x40;
@@ -435,47 +437,54 @@ static void mcb_set_name(uint16_t mcb, const char *buf)
         put8(mcb * 16 + 8 + i, buf[i]);
 }
 
-static uint16_t mcb_ok(uint16_t mcb)
-{
-    return get8(mcb * 16) == 'Z' || get8(mcb * 16) == 'M';
-}
-
 static int mcb_is_last(uint16_t mcb)
 {
     return get8(mcb * 16) == 'Z';
 }
 
-static uint16_t mcb_next(uint16_t mcb)
+static void mcb_set_last(uint16_t mcb, int last)
 {
-    if(mcb <= 0 || mcb_is_last(mcb))
-        return 0;
-    return mcb + mcb_size(mcb) + 1;
+    put8(mcb * 16 + 0, last ? 'Z' : 'M');
 }
 
-static void mcb_set_last(uint16_t mcb, int last)
+// MCB header fields, read once per step when walking the chain
+struct mcb_hdr
 {
-    put8(mcb * 16 + 0, last ? 'Z' : 'M');
+    uint8_t type;
+    uint16_t owner;
+    uint16_t size;
+};
+
+static void mcb_read(uint16_t mcb, struct mcb_hdr *h)
+{
+    h->type = get8(mcb * 16);
+    h->owner = get16(mcb * 16 + 1);
+    h->size = get16(mcb * 16 + 3);
 }
 
-static int mcb_is_free(uint16_t mcb)
+static int mcb_hdr_free(const struct mcb_hdr *h)
 {
-    return mcb_ok(mcb) && mcb_owner(mcb) == 0;
+    return (h->type == 'M' || h->type == 'Z') && h->owner == 0;
 }
 
 static uint16_t mcb_grow_max(uint16_t mcb)
 {
-    uint16_t total = mcb_size(mcb);
-    if(mcb_is_last(mcb))
+    struct mcb_hdr h, nh;
+    mcb_read(mcb, &h);
+    uint16_t total = h.size;
+    if(h.type == 'Z')
         return total;
-    uint16_t nxt = mcb_next(mcb);
-    while(mcb_is_free(nxt))
+    uint16_t nxt = mcb + h.size + 1;
+    mcb_read(nxt, &nh);
+    while(mcb_hdr_free(&nh))
     {
-        total += 1 + mcb_size(nxt);
+        total += 1 + nh.size;
         mcb_set_size(mcb, total);
-        mcb_set_last(mcb, mcb_is_last(nxt));
-        if(mcb_is_last(nxt))
+        mcb_set_last(mcb, nh.type == 'Z');
+        if(nh.type == 'Z')
             break;
-        nxt = mcb_next(nxt);
+        nxt = nxt + nh.size + 1;
+        mcb_read(nxt, &nh);
     }
     return total;
 }
@@ -494,9 +503,11 @@ static uint16_t mcb_alloc_new(uint16_t size, uint16_t owner, uint16_t *max)
     *max = 0;
     while(1)
     {
-        if(mcb_is_free(mcb))
+        struct mcb_hdr h;
+        mcb_read(mcb, &h);
+        if(mcb_hdr_free(&h))
         {
-            int slack = mcb_size(mcb) - size;
+            int slack = h.size - size;
             if(slack >= 0)
             {
                 if(!best || (stg == 1 && slack < best_slack) || (stg >= 2))
@@ -505,12 +516,12 @@ static uint16_t mcb_alloc_new(uint16_t size, uint16_t owner, uint16_t *max)
                     best = mcb;
                 }
             }
-            else if(mcb_size(mcb) > *max)
-                *max = mcb_size(mcb);
+            else if(h.size > *max)
+                *max = h.size;
         }
-        if(mcb_is_last(mcb))
+        if(h.type == 'Z')
             break;
-        mcb = mcb_next(mcb);
+        mcb = mcb + h.size + 1;
     }
     if(!best)
         return 0; // No mcb is big enough
@@ -590,14 +601,20 @@ uint16_t mem_alloc_segment(uint16_t size, uint16_t *max)
 
 void mem_free_owned(unsigned psp_seg)
 {
-    int mcb = mcb_start;
+    uint16_t mcb = mcb_start;
     while(1)
     {
-        if(mcb_owner(mcb) == psp_seg)
+        struct mcb_hdr h;
+        mcb_read(mcb, &h);
+        if(h.owner == psp_seg)
+        {
+            // Freeing merges the following free blocks, read the result
             mcb_free(mcb);
-        if(mcb_is_last(mcb))
+            mcb_read(mcb, &h);
+        }
+        if(h.type == 'Z')
             break;
-        mcb = mcb_next(mcb);
+        mcb = mcb + h.size + 1;
     }
 }
 
@@ -779,40 +796,249 @@ void set_current_PSP(uint16_t psp_seg)
     put16(indos_flag + 0xF, psp_seg);
 }
 
-static unsigned g16(uint8_t *buf)
+static unsigned g16(const uint8_t *buf)
 {
     return buf[0] + (buf[1] << 8);
 }
 
+// Contents of an executable file, mapped when possible.
+struct exe_file
+{
+    const uint8_t *data;
+    size_t size;
+    int mapped;
+};
+
+// Biggest file read when it can't be mapped, more than fits in DOS memory.
+#define EXE_READ_MAX 0x200000
+
+static int exe_open(FILE *f, struct exe_file *ef)
+{
+    struct stat st;
+    int fd = fileno(f);
+
+    ef->data = 0;
+    ef->size = 0;
+    ef->mapped = 0;
+    if(!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED)
+        {
+            ef->data = p;
+            ef->size = st.st_size;
+            ef->mapped = 1;
+            return 0;
+        }
+    }
+
+    // Not a regular file, read it
+    uint8_t *buf = malloc(EXE_READ_MAX);
+    if(!buf)
+        return 1;
+    fseek(f, 0, SEEK_SET);
+    ef->data = buf;
+    ef->size = fread(buf, 1, EXE_READ_MAX, f);
+    return 0;
+}
+
+static void exe_close(struct exe_file *ef)
+{
+    if(ef->mapped)
+        munmap((void *)ef->data, ef->size);
+    else
+        free((void *)ef->data);
+}
+
+// Returns the number of bytes available from offset "off", at most "max".
+static unsigned exe_avail(const struct exe_file *ef, unsigned off, unsigned max)
+{
+    if(off >= ef->size)
+        return 0;
+    return ef->size - off < max ? ef->size - off : max;
+}
+
+// Copies "n" bytes of the file at "off" to guest memory at "addr".
+static void exe_copy(const struct exe_file *ef, unsigned off, uint32_t addr, unsigned n)
+{
+#ifdef IA32
+    meml_writes(addr, ef->data + off, n);
+#else
+    memcpy(memory + addr, ef->data + off, n);
+#endif
+}
+
+// Returns 1 if all relocations patch words inside the "n" bytes loaded at
+// "load_seg", so the relocated image is a copy of that memory.
+static int exe_relocs_inside(const struct exe_file *ef, const uint8_t *hdr, uint16_t load_seg,
+                             unsigned n)
+{
+    unsigned reloc_off = g16(hdr + 24);
+    unsigned nreloc = g16(hdr + 6);
+    unsigned avail = exe_avail(ef, reloc_off, nreloc * 4) / 4;
+    const uint8_t *reloc = ef->data + reloc_off;
+
+    for(unsigned i = 0; i < avail; i++, reloc += 4)
+    {
+        uint16_t rseg = load_seg + g16(reloc + 2);
+        int off = g16(reloc) + 16 * rseg - 16 * load_seg;
+        if(off < 0 || off + 2 > (int)n)
+            return 0;
+    }
+    return 1;
+}
+
+// Applies the relocation table, returns 0 if it is truncated.
+static int exe_relocate(const struct exe_file *ef, const uint8_t *hdr, uint16_t load_seg,
+                        uint16_t reloc_seg)
+{
+    unsigned reloc_off = g16(hdr + 24);
+    unsigned nreloc = g16(hdr + 6);
+    unsigned avail = exe_avail(ef, reloc_off, nreloc * 4) / 4;
+    const uint8_t *reloc = ef->data + reloc_off;
+
+    for(unsigned i = 0; i < avail; i++, reloc += 4)
+    {
+        uint16_t roff = g16(reloc);
+        uint16_t rseg = load_seg + g16(reloc + 2);
+        int pos = roff + 16 * rseg;
+        put16(pos, get16(pos) + reloc_seg);
+    }
+    return avail == nreloc;
+}
+
+// Overlays already loaded, so that programs swapping overlays with
+// INT 21h/4B03 don't read and relocate the same image each time.
+#define OVL_CACHE_MAX (8 * 1024 * 1024)
+
+// File times with nanoseconds, so that a file rewritten within the same
+// second is not taken from the cache.
+#ifdef __APPLE__
+#define ST_MTIM(st) ((st)->st_mtimespec)
+#define ST_CTIM(st) ((st)->st_ctimespec)
+#else
+#define ST_MTIM(st) ((st)->st_mtim)
+#define ST_CTIM(st) ((st)->st_ctim)
+#endif
+
+static int same_time(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+struct ovl_cache
+{
+    struct ovl_cache *next;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime, ctime;
+    uint16_t load_seg, reloc_seg;
+    unsigned len;
+    uint8_t data[];
+};
+
+// Most recently used first
+static struct ovl_cache *ovl_cache_list;
+static unsigned ovl_cache_bytes;
+
+static struct ovl_cache *ovl_cache_find(const struct stat *st, uint16_t load_seg,
+                                        uint16_t reloc_seg)
+{
+    struct ovl_cache **pc;
+    for(pc = &ovl_cache_list; *pc; pc = &(*pc)->next)
+    {
+        struct ovl_cache *c = *pc;
+        if(c->dev == st->st_dev && c->ino == st->st_ino && c->size == st->st_size &&
+           same_time(&c->mtime, &ST_MTIM(st)) && same_time(&c->ctime, &ST_CTIM(st)) &&
+           c->load_seg == load_seg && c->reloc_seg == reloc_seg)
+        {
+            // Move to front
+            *pc = c->next;
+            c->next = ovl_cache_list;
+            ovl_cache_list = c;
+            return c;
+        }
+    }
+    return 0;
+}
+
+// Stores the "len" bytes loaded at "load_seg", dropping the least recently
+// used overlays to stay below OVL_CACHE_MAX.
+static void ovl_cache_add(const struct stat *st, uint16_t load_seg, uint16_t reloc_seg,
+                          unsigned len)
+{
+    if(len > OVL_CACHE_MAX)
+        return;
+    while(ovl_cache_list && ovl_cache_bytes + len > OVL_CACHE_MAX)
+    {
+        struct ovl_cache **pc = &ovl_cache_list;
+        while((*pc)->next)
+            pc = &(*pc)->next;
+        ovl_cache_bytes -= (*pc)->len;
+        free(*pc);
+        *pc = 0;
+    }
+    struct ovl_cache *c = malloc(sizeof(struct ovl_cache) + len);
+    if(!c)
+        return;
+    c->dev = st->st_dev;
+    c->ino = st->st_ino;
+    c->size = st->st_size;
+    c->mtime = ST_MTIM(st);
+    c->ctime = ST_CTIM(st);
+    c->load_seg = load_seg;
+    c->reloc_seg = reloc_seg;
+    c->len = len;
+#ifdef IA32
+    meml_reads(load_seg * 16, c->data, len);
+#else
+    memcpy(c->data, memory + load_seg * 16, len);
+#endif
+    c->next = ovl_cache_list;
+    ovl_cache_list = c;
+    ovl_cache_bytes += len;
+}
+
 int dos_read_overlay(FILE *f, uint16_t load_seg, uint16_t reloc_seg)
 {
-    // First, read one block
-    uint8_t buf[32];
-    unsigned n = fread(buf, 1, sizeof(buf), f);
-    if(n < 28 || g16(buf) != 0x5a4d)
+    struct stat st;
+    int cache = !fstat(fileno(f), &st) && S_ISREG(st.st_mode);
+    if(cache)
     {
-        // COM file. Read rest of data
-        if(!n)
-            return 1;
+        struct ovl_cache *c = ovl_cache_find(&st, load_seg, reloc_seg);
+        if(c)
+        {
+            debug(debug_dos, "\toverlay cached, %u bytes\n", c->len);
+#ifdef IA32
+            meml_writes(load_seg * 16, c->data, c->len);
+#else
+            memcpy(memory + load_seg * 16, c->data, c->len);
+#endif
+            return 0;
+        }
+    }
 
+    struct exe_file ef;
+    if(exe_open(f, &ef))
+        return 1;
+    int ret = 1;
+    const uint8_t *buf = ef.data;
+    unsigned n = exe_avail(&ef, 0, 32);
+    if(n < 28 || g16(buf) != 0x5a4d)
+    {
+        // COM file. Load all data
         int mem = load_seg * 16;
         int max = 0x100000 - mem - 512;
-        fseek(f, 0, SEEK_SET);
-#ifdef IA32
-        char *loadbuf = malloc(max);
-        if(!loadbuf)
-            return 1;
-        n = fread(loadbuf, 1, max, f);
-        if(n)
-            meml_writes(mem, loadbuf, n);
-        free(loadbuf);
-#else  // not IA32
-        n = fread(memory + mem, 1, max, f);
-#endif // IA32
-        return n == 0;
+        n = exe_avail(&ef, 0, max);
+        exe_copy(&ef, 0, mem, n);
+        ret = n == 0;
+        if(cache && n)
+            ovl_cache_add(&st, load_seg, reloc_seg, n);
+        goto out;
     }
 
-    // An EXE file, read rest of blocks
+    // An EXE file, load the data blocks
     unsigned head_size = g16(buf + 8) * 16;
     unsigned data_size = g16(buf + 4) * 512 + g16(buf + 2) - head_size;
     if(g16(buf + 2))
@@ -821,57 +1047,37 @@ int dos_read_overlay(FILE *f, uint16_t load_seg, uint16_t reloc_seg)
     if(data_size >= 0x100000 || load_seg * 16 + data_size >= 0x100000)
     {
         debug(debug_dos, "\texe size too big for memory\n");
-        return 1;
+        goto out;
     }
 
-    // Seek to start of data
-    fseek(f, head_size, SEEK_SET);
-#ifdef IA32
-    char *loadbuf = malloc(data_size);
-    if(!loadbuf)
-        return 1;
-    n = fread(loadbuf, 1, data_size, f);
+    n = exe_avail(&ef, head_size, data_size);
     if(n == data_size)
-        meml_writes(load_seg * 16, loadbuf, n);
-    free(loadbuf);
-#else  // not IA32
-    n = fread(memory + load_seg * 16, 1, data_size, f);
-#endif // IA32
+        exe_copy(&ef, head_size, load_seg * 16, n);
     debug(debug_dos, "\texe read %u of %u data bytes\n", n, data_size);
     if(n < data_size)
-        return 1;
-
-    unsigned reloc_off = g16(buf + 24);
-    int nreloc = g16(buf + 6);
-
-    // Seek to start of relocation data
-    fseek(f, reloc_off, SEEK_SET);
-    while(nreloc)
-    {
-        uint8_t reloc[4];
-        if(4 != fread(reloc, 1, 4, f))
-            return 1;
-        uint16_t roff = g16(reloc);
-        uint16_t rseg = load_seg + g16(reloc + 2);
-        int pos = roff + 16 * rseg;
-        uint16_t n = get16(pos);
-        put16(pos, n + reloc_seg);
-        reloc_off += 4;
-        nreloc--;
-    }
-    return 0;
+        goto out;
+
+    ret = !exe_relocate(&ef, buf, load_seg, reloc_seg);
+    if(cache && !ret && exe_relocs_inside(&ef, buf, load_seg, n))
+        ovl_cache_add(&st, load_seg, reloc_seg, n);
+out:
+    exe_close(&ef);
+    return ret;
 }
 
 int dos_load_exe(FILE *f, uint16_t psp_mcb)
 {
-    // First, read exe header
-    uint8_t buf[32];
-    unsigned n = fread(buf, 1, sizeof(buf), f);
+    struct exe_file ef;
+    if(exe_open(f, &ef))
+        return 0;
+    int ret = 0;
+    const uint8_t *buf = ef.data;
+    unsigned n = exe_avail(&ef, 0, 32);
     if(n < 28 || g16(buf) != 0x5a4d)
     {
-        // COM file. Read rest of data
+        // COM file. Load all data
         if(!n)
-            return 0;
+            goto out;
 
         // Expand MCB to fill all memory
         mcb_resize(psp_mcb, 0xFFFF);
@@ -879,20 +1085,10 @@ int dos_load_exe(FILE *f, uint16_t psp_mcb)
         int max = (mcb_size(psp_mcb) - 16) * 16;
 
         int mem = (psp_mcb + 17) * 16;
-        fseek(f, 0, SEEK_SET);
-#ifdef IA32
-        char *loadbuf = malloc(max);
-        if(!loadbuf)
-            return 0;
-        n = fread(loadbuf, 1, max, f);
-        if(n)
-            meml_writes(mem, loadbuf, n);
-        free(loadbuf);
-#else // not IA32
-        n = fread(memory + mem, 1, max, f);
-#endif
+        n = exe_avail(&ef, 0, max);
+        exe_copy(&ef, 0, mem, n);
         if(!n)
-            return 0;
+            goto out;
 
         // Fill top program address in PSP
         put16(psp_mcb * 16 + 16 + 2, psp_mcb + mcb_size(psp_mcb) + 1);
@@ -911,10 +1107,11 @@ int dos_load_exe(FILE *f, uint16_t psp_mcb)
         cpuSetSI(cpuGetIP());
         cpuSetDI(cpuGetSP());
 
-        return 1;
+        ret = 1;
+        goto out;
     }
 
-    // An EXE file, read rest of blocks
+    // An EXE file, load the data blocks
     unsigned head_size = g16(buf + 8) * 16;
     unsigned data_blocks = g16(buf + 4);
     unsigned extra_bytes = g16(buf + 2);
@@ -940,7 +1137,7 @@ int dos_load_exe(FILE *f, uint16_t psp_mcb)
     {
         debug(debug_dos, "\texe read, not enough memory! (need:%d) (actual:%d)\n", min_sz,
               psp_sz);
-        return 0;
+        goto out;
     }
 
     debug(debug_dos, "\texe: bin=%04x min=%04x max=%04x, alloc %04x segments of memory\n",
@@ -949,19 +1146,9 @@ int dos_load_exe(FILE *f, uint16_t psp_mcb)
     // Fill top program address in PSP
     put16(psp_mcb * 16 + 16 + 2, psp_mcb + mcb_size(psp_mcb) + 1);
 
-    // Seek to start of data and read
-    fseek(f, head_size, SEEK_SET);
-#ifdef IA32
-    char *loadbuf = malloc(data_size);
-    if(!loadbuf)
-        return 1;
-    n = fread(loadbuf, 1, data_size, f);
-    if(n)
-        meml_writes(load_seg * 16, loadbuf, n);
-    free(loadbuf);
-#else  // not IA32
-    n = fread(memory + load_seg * 16, 1, data_size, f);
-#endif // IA32
+    // Copy the data to the load address
+    n = exe_avail(&ef, head_size, data_size);
+    exe_copy(&ef, head_size, load_seg * 16, n);
     // Adjust data_size depending on extra_bytes
     if(extra_bytes)
         data_size = data_size - 512 + extra_bytes;
@@ -969,7 +1156,7 @@ int dos_load_exe(FILE *f, uint16_t psp_mcb)
     if(!n)
     {
         debug(debug_dos, "\texe too short!\n");
-        return 0;
+        goto out;
     }
     else if(n < data_size)
         debug(debug_dos, "\tWARNING: short program!\n");
@@ -995,22 +1182,8 @@ int dos_load_exe(FILE *f, uint16_t psp_mcb)
     cpuSetSI(cpuGetIP());
     cpuSetDI(cpuGetSP());
 
-    unsigned reloc_off = g16(buf + 24);
-    int nreloc = g16(buf + 6);
-    // Seek to start of relocation data
-    fseek(f, reloc_off, SEEK_SET);
-    while(nreloc)
-    {
-        uint8_t reloc[4];
-        if(4 != fread(reloc, 1, 4, f))
-            return 0;
-        uint16_t roff = g16(reloc);
-        uint16_t rseg = load_seg + g16(reloc + 2);
-        int pos = roff + 16 * rseg;
-        uint16_t n = get16(pos);
-        put16(pos, n + load_seg);
-        reloc_off += 4;
-        nreloc--;
-    }
-    return 1;
+    ret = exe_relocate(&ef, buf, load_seg, load_seg);
+out:
+    exe_close(&ef);
+    return ret;
 }
@@ -9,11 +9,13 @@
 #include "keyb.h"
 #include "os.h"
 #include "timer.h"
+#include "utils.h"
 #include "video.h"
 #ifdef EMS_SUPPORT
 #include "ems.h"
 #endif /* EMS_SUPPORT */
 #include "extmem.h"
+#include "idle.h"
 #include "pic.h"
 
 #include <errno.h>
@@ -25,6 +27,7 @@
 #include <string.h>
 #include <sys/time.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 uint8_t read_port(unsigned port)
@@ -34,6 +37,7 @@ uint8_t read_port(unsigned port)
     {
         static int retrace = 0;
         retrace++;
+        idle_poll();
         return (retrace >> 1) & 0x09;
     }
     else if(port == 0x3D4 || port == 0x3D5)
@@ -75,6 +79,8 @@ void emulator_update(void)
 {
     debug(debug_int, "emu update cycle\n");
     cpuTriggerIRQ(0);
+    timer_tick();
+    idle_tick();
     update_timer();
     check_screen();
     update_keyb();
@@ -113,7 +119,8 @@ static void farcall_entry(void)
     uint16_t cs = cpuGetStack(2);
     uint32_t ret_addr = cpuGetAddress(cs, ip);
 
-    for(int i = 0; i < NELEMENTS(FARCALL_ENTRY_LIST); i++)
+    // Entries are registered in order, stop at the first free one
+    for(int i = 0; i < NELEMENTS(FARCALL_ENTRY_LIST) && FARCALL_ENTRY_LIST[i].func; i++)
     {
         if(FARCALL_ENTRY_LIST[i].return_addr == ret_addr)
         {
@@ -271,68 +278,105 @@ NORETURN static void intr19(void)
     exit(0);
 }
 
+// Unimplemented opcode trap
+static void intr06(void)
+{
+    uint16_t ip = cpuGetStack(0);
+    uint16_t cs = cpuGetStack(2);
+    print_error("error, unimplemented opcode %02X at cs:ip = %04X:%04X\n",
+                get8(cpuGetAddress(cs, ip)), cs, ip);
+}
+
+// Timer hook from timer interrupt
+static void intr1c(void) {}
+
+// Handlers for our interrupt vectors, indexed by interrupt number
+static struct
+{
+    bios_handler func;
+    unsigned long calls;
+    double time;
+} bios_table[256];
+static int bios_timing;
+
+bios_handler reg_bios_routine(unsigned inum, bios_handler func)
+{
+    bios_handler old = bios_table[inum & 0xFF].func;
+    bios_table[inum & 0xFF].func = func;
+    return old;
+}
+
+BIOS_IRET(intr06)
+BIOS_IRET(intr11)
+BIOS_IRET(intr12)
+BIOS_IRET(intr15)
+BIOS_IRET(intr19)
+BIOS_IRET(intr1c)
+BIOS_IRET(intr25)
+BIOS_IRET(intr2a)
+BIOS_IRET(farcall_entry)
+
+// Host times change from run to run, so they are only added on request
+static void bios_stats(void)
+{
+    for(int i = 0; i < 256; i++)
+    {
+        if(!bios_table[i].calls)
+            continue;
+        if(bios_timing)
+            debug(debug_int, "INT %02X: %lu calls, %.3f ms\n", i,
+                  bios_table[i].calls, bios_table[i].time * 1000.0);
+        else
+            debug(debug_int, "INT %02X: %lu calls\n", i, bios_table[i].calls);
+    }
+}
+
+static void init_bios_routines(void)
+{
+    // The DOS, EMS, keyboard, timer and video code register their own
+    reg_bios_routine(0x06, intr06_iret);
+    reg_bios_routine(0x11, intr11_iret);
+    reg_bios_routine(0x12, intr12_iret);
+    reg_bios_routine(0x15, intr15_iret);
+    reg_bios_routine(0x19, intr19_iret);
+    reg_bios_routine(0x1C, intr1c_iret);
+    reg_bios_routine(0x25, intr25_iret);
+    reg_bios_routine(0x2A, intr2a_iret);
+    reg_bios_routine(0xFE, farcall_entry_iret); // farcall entry for XMS and etc.
+    // Time the handlers only when the times are shown
+    if(debug_active(debug_int))
+    {
+        bios_timing = getenv(ENV_INT_TIMES) != 0;
+        atexit(bios_stats);
+    }
+}
+
 // DOS/BIOS interface
 // return value = 1, call by jmp
 // return value = 0, call by iret
 int bios_routine(unsigned inum)
 {
-    int ret = 0;
+    int ret;
     if(inum >= 0x08 && inum <= 0x0f)
         pic_eoi(inum - 0x08);
     else if(inum >= 0x70 && inum <= 0x78)
         pic_eoi(inum - 0x70);
 
-    if(inum == 0x21)
-        ret = intr21();
-    else if(inum == 0x20)
-        intr20();
-    else if(inum == 0x22)
-        intr22();
-    else if(inum == 0x1A)
-        intr1A();
-    else if(inum == 0x19)
-        intr19();
-    else if(inum == 0x16)
-        intr16();
-    else if(inum == 0x10)
-        intr10();
-    else if(inum == 0x11)
-        intr11();
-    else if(inum == 0x12)
-        intr12();
-    else if(inum == 0x15)
-        intr15();
-    else if(inum == 0x06)
+    bios_handler func = bios_table[inum].func;
+    if(!func)
     {
-        uint16_t ip = cpuGetStack(0);
-        uint16_t cs = cpuGetStack(2);
-        print_error("error, unimplemented opcode %02X at cs:ip = %04X:%04X\n",
-                    get8(cpuGetAddress(cs, ip)), cs, ip);
-    }
-    else if(inum == 0x28)
-        intr28();
-    else if(inum == 0x25)
-        intr25();
-    else if(inum == 0x29)
-        intr29();
-    else if(inum == 0x2A)
-        intr2a();
-    else if(inum == 0x2f)
-        intr2f();
-    // else if(inum == 0x8)
-    //     ; // Timer interrupt - nothing to do
-    else if(inum == 0x9)
-        keyb_handle_irq(); // Keyboard interrupt
-    else if(inum == 0x1c)
-        ; // Timer hook from timer interrupt
-#ifdef EMS_SUPPORT
-    else if(use_ems && inum == 0x67)
-        intr67();
-#endif
-    else if(inum == 0xFE) // farcall entry for XMS and etc. functions
-        farcall_entry();
-    else
         debug(debug_int, "UNHANDLED INT %02x, AX=%04x\n", inum, cpuGetAX());
+        return 0;
+    }
+    bios_table[inum].calls++;
+    if(!bios_timing)
+        return func();
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    ret = func();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    bios_table[inum].time += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
     return ret;
 }
 
@@ -366,7 +410,9 @@ static void check_exit_mem(void)
     }
 }
 
+uint8_t *memory;
 volatile int exit_cpu;
+long cpu_steps;
 static void timer_alarm(int x)
 {
     exit_cpu = 1;
@@ -539,10 +585,9 @@ int main(int argc, char **argv)
             print_error("%s must be power of 2\n", ENV_MEMSIZE);
     }
     debug(debug_dos, "set MEMSIZE = %d\n", memsize);
-    memory = malloc(memsize * 1024 * 1024);
+    memory = alloc_guest_memory(memsize * 1024 * 1024);
     if(!memory)
         print_error("cannot allocate memory %d MB\n", memsize);
-    memset(memory, 0, 1024 * 1024); // clear first 1MB
 
     init_cpu();
 
@@ -555,10 +600,13 @@ int main(int argc, char **argv)
         cpuSetES(0);
         cpuSetSP(0xFFFF);
         cpuSetSS(0);
+        init_dos_routines();
     }
     else
         init_dos(argc - 1, argv + 1);
     init_xms(memsize);
+    init_keyb();
+    init_bios_routines();
 
     struct sigaction timer_action, exit_action;
     exit_action.sa_handler = exit_handler;
@@ -573,12 +621,17 @@ int main(int argc, char **argv)
     sigaction(SIGQUIT, &exit_action, NULL);
     sigaction(SIGPIPE, &exit_action, NULL);
     sigaction(SIGTERM, &exit_action, NULL);
-    struct itimerval itv;
-    itv.it_interval.tv_sec = 0;
-    itv.it_interval.tv_usec = 54925;
-    itv.it_value.tv_sec = 0;
-    itv.it_value.tv_usec = 54925;
-    setitimer(ITIMER_REAL, &itv, 0);
+    // With virtual time the ticks are generated from the CPU loop
+    init_timer();
+    if(!timer_is_virtual())
+    {
+        struct itimerval itv;
+        itv.it_interval.tv_sec = 0;
+        itv.it_interval.tv_usec = 54925;
+        itv.it_value.tv_sec = 0;
+        itv.it_value.tv_usec = 54925;
+        setitimer(ITIMER_REAL, &itv, 0);
+    }
     init_bios_mem();
     video_init_mem();
     while(1)
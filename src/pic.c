@@ -55,6 +55,22 @@ static struct pic_stat pic[2] = {
 
 #define PIC_CASCADED 2
 
+// Non-zero while any IRR bit is set, so the CPU loop can skip handle_irq().
+int pic_irq_pending;
+
+static void update_irq_pending(void)
+{
+    pic_irq_pending = pic[0].IRR | pic[1].IRR;
+}
+
+// Non-zero if a request is not masked, so that it can interrupt a HLT.
+int pic_irq_unmasked(void)
+{
+    if(pic[0].IRR & ~pic[0].IMR)
+        return 1;
+    return (pic[1].IRR & ~pic[1].IMR) && !(pic[0].IMR & (0x01 << PIC_CASCADED));
+}
+
 #ifdef IA32
 extern void ia32_interrupt(int vect, int soft);
 #define cpu_hard_interrupt(n) ia32_interrupt(n, 0)
@@ -80,6 +96,7 @@ void pic_reinit(void)
     pic[1].irq_base = 0x70;
     pic[0].IMR = 0xf8;
     pic[1].IMR = 0xff;
+    update_irq_pending();
 }
 
 uint8_t port_pic_read(unsigned port)
@@ -134,6 +151,7 @@ void port_pic_write(unsigned port, uint8_t value)
             pic[pic_idx].pending = 0x00;
             pic[pic_idx].special_mask = 0;
             pic[pic_idx].data_read = PIC_READ_IRR;
+            update_irq_pending();
         }
         else if(value & PIC_OCW3_FLAG)
         {
@@ -189,6 +207,7 @@ void port_pic_write(unsigned port, uint8_t value)
             pic[pic_idx].special_nest = (value & PIC_ICW4_SPECIAL_NEST) ? 1 : 0;
             pic[pic_idx].initializing = 0;
             pic[pic_idx].IRR = pic[pic_idx].pending;
+            update_irq_pending();
         }
         else
         {
@@ -224,6 +243,7 @@ void cpuTriggerIRQ(int num)
         pic[pic_idx].pending |= 0x01 << num;
     else
         pic[pic_idx].IRR |= 0x01 << num;
+    update_irq_pending();
 }
 
 void handle_irq(void)
@@ -303,4 +323,5 @@ void handle_irq(void)
             }
         }
     }
+    update_irq_pending();
 }
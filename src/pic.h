@@ -3,9 +3,12 @@
 
 #include <stdint.h>
 
+extern int pic_irq_pending;
+
 void pic_reinit(void);
 uint8_t port_pic_read(unsigned port);
 void port_pic_write(unsigned port, uint8_t value);
 void pic_eoi(int num);
 void cpuTriggerIRQ(int num);
 void handle_irq(void);
+int pic_irq_unmasked(void);
@@ -2,12 +2,92 @@
 #include "timer.h"
 #include "dbg.h"
 #include "emu.h"
+#include "env.h"
+#include "idle.h"
 
 #include <inttypes.h>
+#include <limits.h>
 #include <math.h>
+#include <stdlib.h>
 #include <sys/time.h>
 #include <time.h>
 
+// Virtual time: the emulated clock advances "vtime_steps" instructions per
+// timer tick instead of following the host clock, and skips to the next tick
+// when the program is idle. This makes time-delay loops run at full speed.
+#define VTIME_MIN_STEPS     1000
+#define VTIME_DEFAULT_STEPS 100000
+static long vtime_steps = 0;
+static uint64_t vtime_ticks = 0;
+static struct timeval vtime_start;
+
+BIOS_IRET(intr1A)
+
+void init_timer(void)
+{
+    const char *turbo = getenv(ENV_TURBO);
+    const char *determ = getenv(ENV_DETERM);
+    if(turbo || determ)
+    {
+        vtime_steps = turbo ? strtol(turbo, 0, 0) : 0;
+        // Allow "EMU2_TURBO=1" to simply enable it
+        if(vtime_steps < VTIME_MIN_STEPS)
+            vtime_steps = VTIME_DEFAULT_STEPS;
+        if(determ)
+        {
+            // Deterministic mode: the time depends only on the executed
+            // instructions, start at a fixed local time.
+            struct tm lt = {.tm_year = 90, .tm_mday = 1, .tm_isdst = -1};
+            vtime_start.tv_sec = mktime(&lt);
+            vtime_start.tv_usec = 0;
+        }
+        else
+            gettimeofday(&vtime_start, 0);
+        debug(debug_int, "virtual time, %ld instructions per tick\n", vtime_steps);
+    }
+    cpu_steps = vtime_steps ? vtime_steps : LONG_MAX;
+    reg_bios_routine(0x1A, intr1A_iret);
+}
+
+int timer_is_virtual(void)
+{
+    return vtime_steps != 0;
+}
+
+void timer_tick(void)
+{
+    if(vtime_steps)
+        vtime_ticks++;
+    cpu_steps = vtime_steps ? vtime_steps : LONG_MAX;
+}
+
+// Returns the host time or the virtual time.
+static void get_time(struct timeval *tv)
+{
+    if(!vtime_steps)
+    {
+        gettimeofday(tv, 0);
+        return;
+    }
+    // Ticks are 1080/19663 seconds, round up to the microsecond so that
+    // the BIOS count read at the tick is already incremented.
+    long steps = vtime_steps - (cpu_steps > 0 ? cpu_steps : 0);
+    uint64_t us = vtime_ticks * 1080000000 / 19663;
+    uint64_t rem = vtime_ticks * 1080000000 % 19663;
+    uint64_t den = 19663 * (uint64_t)vtime_steps;
+    us += (rem * vtime_steps + steps * (uint64_t)1080000000 + den - 1) / den;
+    us += vtime_start.tv_usec;
+    tv->tv_sec = vtime_start.tv_sec + us / 1000000;
+    tv->tv_usec = us % 1000000;
+}
+
+time_t timer_time(void)
+{
+    struct timeval tv;
+    get_time(&tv);
+    return tv.tv_sec;
+}
+
 // Emulate BIOS time
 static uint32_t bios_timer = 0;
 static uint16_t bios_dater = 0;
@@ -26,7 +106,7 @@ static int64_t time_to_bios(struct timeval tv)
 void update_timer(void)
 {
     struct timeval tv;
-    gettimeofday(&tv, 0);
+    get_time(&tv);
     if(start_timer == 0) {
         // Create a time_t value at the start of the day, in local time
         struct timeval td = tv;
@@ -48,7 +128,7 @@ void update_timer(void)
 static void set_timer(unsigned x)
 {
     struct timeval tv;
-    gettimeofday(&tv, 0);
+    get_time(&tv);
     start_timer = time_to_bios(tv) + x;
     update_timer();
 }
@@ -77,7 +157,7 @@ static struct i8253_timer
 static long get_timer_clock(void)
 {
     struct timeval tv;
-    gettimeofday(&tv, 0);
+    get_time(&tv);
     // us in microseconds
     // (don't use full seconds resolution, to avoid losing precision
     double us = (tv.tv_sec & 0xFFFFFF) * 1000000.0 + tv.tv_usec;
@@ -256,6 +336,7 @@ void intr1A(void)
     {
     case 0: // TIME
     {
+        idle_poll();
         update_timer();
         cpuSetDX(bios_timer & 0xFFFF);
         cpuSetCX((bios_timer >> 16) & 0xFFFF);
@@ -274,7 +355,7 @@ void intr1A(void)
     }
     case 2: // GET RTC TIME
     {
-        time_t tm = time(0);
+        time_t tm = timer_time();
         struct tm lt;
         if(localtime_r(&tm, &lt))
         {
@@ -285,7 +366,7 @@ void intr1A(void)
     }
     case 4: // GET RTC DATE
     {
-        time_t tm = time(0);
+        time_t tm = timer_time();
         struct tm lt;
         if(localtime_r(&tm, &lt))
         {
@@ -1,9 +1,17 @@
 #pragma once
 
 #include <stdint.h>
+#include <time.h>
 
-// BIOS TIMER code
+// BIOS TIMER code, init_timer() also registers the INT 1A handler
+void init_timer(void);
 void update_timer(void);
+// Called on each emulated timer tick.
+void timer_tick(void);
+// Returns 1 if the emulated time is virtual, advancing with the CPU.
+int timer_is_virtual(void);
+// Current time, as seen by the emulated machine.
+time_t timer_time(void);
 uint32_t get_bios_timer(void);
 void intr1A(void);
 uint8_t port_timer_read(uint16_t port);
@@ -1,8 +1,15 @@
 /* Platform dependent utility functions */
 #include "utils.h"
 #include "dbg.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+
 #ifdef __APPLE__
 #include <mach-o/dyld.h>
 #endif
@@ -88,3 +95,41 @@ const char *get_program_exe_path(void)
 
 #endif
 }
+
+uint8_t *alloc_guest_memory(size_t size)
+{
+#ifdef MAP_ANONYMOUS
+    // Anonymous pages are zero filled and only allocated when first used
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+    uint8_t *mem = mmap(0, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if(mem == MAP_FAILED)
+        return 0;
+#ifdef MADV_HUGEPAGE
+    // Use huge pages for the extended memory, above the first 2MB
+    const size_t huge = 2 * 1024 * 1024;
+    if(size > 2 * huge)
+        madvise(mem + huge, (size - huge) & ~(huge - 1), MADV_HUGEPAGE);
+#endif
+    return mem;
+#else
+    uint8_t *mem = malloc(size);
+    if(mem)
+        memset(mem, 0, size);
+    return mem;
+#endif
+}
+
+void release_guest_memory(uint8_t *mem, size_t size)
+{
+#if defined(MAP_ANONYMOUS) && defined(MADV_DONTNEED)
+    // Give back the whole pages to the OS, they read as zero after this
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)mem + page - 1) & ~(page - 1);
+    uintptr_t end = ((uintptr_t)mem + size) & ~(page - 1);
+    if(end > start)
+        madvise((void *)start, end - start, MADV_DONTNEED);
+#endif
+}
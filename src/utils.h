@@ -1,5 +1,13 @@
 /* Platform dependent utility functions */
 #pragma once
+#include <stddef.h>
+#include <stdint.h>
 
 /* Returns the full path to the program executable */
 const char *get_program_exe_path(void);
+
+/* Allocates zero filled memory for the emulated RAM */
+uint8_t *alloc_guest_memory(size_t size);
+
+/* Tells the OS that a range of the emulated RAM is not used */
+void release_guest_memory(uint8_t *mem, size_t size);
@@ -3,6 +3,7 @@
 #include "dbg.h"
 #include "emu.h"
 #include "env.h"
+#include "idle.h"
 #include "keyb.h"
 
 #include <errno.h>
@@ -315,6 +316,8 @@ static void vid_set_font(unsigned lines)
     update_posxy();
 }
 
+BIOS_IRET(intr10)
+
 void video_init_mem(void)
 {
     // Fill the functionality table
@@ -340,6 +343,7 @@ void video_init_mem(void)
         else if(rows == 12)
             vid_set_font(32);
     }
+    reg_bios_routine(0x10, intr10_iret);
 }
 
 // Writes a DOS character to the current terminal position
@@ -465,6 +469,26 @@ static void debug_screen(void)
     free(buf);
 }
 
+int video_find_text(const uint8_t *text, unsigned len)
+{
+    if(!video_initialized || !len || len > vid_sx)
+        return 0;
+
+    uint16_t memp = (vid_page & 7) * (vid_sy > 25 ? 0x2000 : 0x1000);
+    const uint8_t *vm = memory + 0xB8000 + memp;
+    for(unsigned y = 0; y < vid_sy; y++)
+        for(unsigned x = 0; x + len <= vid_sx; x++)
+        {
+            const uint8_t *p = vm + 2 * (x + y * vid_sx);
+            unsigned i = 0;
+            while(i < len && p[2 * i] == text[i])
+                i++;
+            if(i == len)
+                return 1;
+        }
+    return 0;
+}
+
 static void set_xy_type(unsigned x, unsigned y, enum vram_cell_type type)
 {
     vram_cell_type[x + y * vid_sx] = type;
@@ -816,7 +840,7 @@ void intr10(void)
           cpuGetCX(), cpuGetDX());
 
     // Wake-up keyboard on video calls
-    keyb_wakeup();
+    idle_activity();
 
     if(!video_initialized)
         init_video();
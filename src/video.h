@@ -16,5 +16,7 @@ int video_get_col(void);
 // CRTC port read/write
 uint8_t video_crtc_read(int port);
 void video_crtc_write(int port, uint8_t value);
-// Initializes emulated video memory and tables
+// Initializes emulated video memory and tables, registers the INT 10 handler
 void video_init_mem(void);
+// Returns 1 if the text (in DOS characters) is shown in one line of the screen
+int video_find_text(const uint8_t *text, unsigned len);
@@ -0,0 +1,207 @@
+# Block copy benchmark for the EMS move/exchange (INT 67h AX=5700h/5701h)
+# and XMS move (AH=0Bh) functions. Build it with GNU as and ld:
+#   as --32 -o emsbench.o emsbench.s
+#   ld -m elf_i386 -Ttext=0x100 --oformat binary -o emsbench.com emsbench.o
+# and run it with EMU2_EMSMEM set to 8 pages or more. It prints "OK" when
+# all the calls succeed, or the failing step and status on error.
+
+.code16
+.text
+
+# Conditional jumps to the error exits, as 8086 code has no near Jcc
+.macro jnz_fail label
+    jz 9f
+    jmp \label
+9:
+.endm
+.macro jz_fail label
+    jnz 9f
+    jmp \label
+9:
+.endm
+
+.globl _start
+_start:
+    # Free the memory after the program, for the XMS driver stack
+    movb $0x4a, %ah
+    movw $0x1000, %bx
+    int $0x21
+
+    # Allocate 8 EMS pages and map the first 4 in the page frame
+    movb $'A', step
+    movb $0x43, %ah
+    movw $8, %bx
+    int $0x67
+    orb %ah, %ah
+    jnz_fail ems_fail
+    movw %dx, ems_handle
+    movb $'M', step
+    xorw %bx, %bx
+1:  movb $0x44, %ah
+    movb %bl, %al
+    movw ems_handle, %dx
+    pushw %bx
+    int $0x67
+    popw %bx
+    orb %ah, %ah
+    jnz_fail ems_fail
+    incw %bx
+    cmpw $4, %bx
+    jne 1b
+
+    movw ems_handle, %ax
+    movw %ax, ems_xchg + 12
+    movw %ax, ems_move + 5
+    movw %ax, ems_ems + 5
+    movw %ax, ems_ems + 12
+    movw %cs, ems_xchg + 9
+    movw %cs, ems_move + 16
+
+    # Conventional <-> EMS exchanges, EMS -> page frame and EMS -> EMS moves
+    movb $'E', step
+    movw $LOOPS, %cx
+2:  pushw %cx
+    movw $0x5701, %ax
+    movw $ems_xchg, %si
+    int $0x67
+    orb %ah, %ah
+    jnz_fail ems_fail
+    movw $0x5700, %ax
+    movw $ems_move, %si
+    int $0x67
+    orb %ah, %ah
+    jnz_fail ems_fail
+    movw $0x5700, %ax
+    movw $ems_ems, %si
+    int $0x67
+    cmpb $0x92, %ah         # Overlapping move done, source overwritten
+    jnz_fail ems_fail
+    popw %cx
+    loop 2b
+
+    movb $0x45, %ah
+    movw ems_handle, %dx
+    int $0x67
+
+    # Allocate 64KB of XMS
+    movb $'X', step
+    movw $0x4300, %ax
+    int $0x2f
+    cmpb $0x80, %al
+    jnz_fail xms_fail
+    movw $0x4310, %ax
+    int $0x2f
+    movw %bx, xms_entry
+    movw %es, xms_entry + 2
+    movb $0x09, %ah
+    movw $64, %dx
+    lcall *xms_entry
+    orw %ax, %ax
+    jz_fail xms_fail
+    movw %dx, xms_handle
+    movw %dx, xms_to + 10
+    movw %dx, xms_from + 4
+    movw %cs, xms_to + 8
+    movw %cs, xms_from + 14
+
+    # Conventional <-> XMS moves
+    movw $LOOPS, %cx
+3:  pushw %cx
+    movb $0x0b, %ah
+    movw $xms_to, %si
+    lcall *xms_entry
+    orw %ax, %ax
+    jz_fail xms_fail
+    movb $0x0b, %ah
+    movw $xms_from, %si
+    lcall *xms_entry
+    orw %ax, %ax
+    jz_fail xms_fail
+    popw %cx
+    loop 3b
+
+    movb $0x0a, %ah
+    movw xms_handle, %dx
+    lcall *xms_entry
+
+    movw $msg_ok, %dx
+    movb $0x09, %ah
+    int $0x21
+    movw $0x4c00, %ax
+    int $0x21
+
+xms_fail:
+    movb %bl, %ah
+ems_fail:
+    # Print the step and the status in AH
+    movb %ah, %al
+    movb $4, %cl
+    shrb %cl, %al
+    call hex_digit
+    movb %al, msg_err + 7
+    movb %ah, %al
+    andb $15, %al
+    call hex_digit
+    movb %al, msg_err + 8
+    movb step, %al
+    movb %al, msg_err + 5
+    movw $msg_err, %dx
+    movb $0x09, %ah
+    int $0x21
+    movw $0x4c01, %ax
+    int $0x21
+
+hex_digit:
+    addb $'0', %al
+    cmpb $'9', %al
+    jbe 1f
+    addb $7, %al
+1:  ret
+
+.set LOOPS, 5000
+
+msg_ok:  .ascii "OK\r\n$"
+msg_err: .ascii "FAIL ? ??\r\n$"
+step:    .byte 0
+ems_handle: .word 0
+xms_handle: .word 0
+xms_entry:  .long 0
+
+# EMS move: length(4), source type(1) handle(2) offset(2) segment/page(2),
+# destination type(1) handle(2) offset(2) segment/page(2)
+ems_xchg:   # 32KB conventional <-> EMS pages 4-5
+    .long 0x8000
+    .byte 0
+    .word 0, buffer, 0
+    .byte 1
+    .word 0, 0, 4
+ems_move:   # 20KB EMS pages 6-7 -> conventional
+    .long 0x5000
+    .byte 1
+    .word 0, 0, 6
+    .byte 0
+    .word 0, buffer, 0
+ems_ems:    # 24KB overlapping EMS -> EMS
+    .long 0x6000
+    .byte 1
+    .word 0, 0x10, 0
+    .byte 1
+    .word 0, 0x1000, 0
+
+# XMS move: length(4), source handle(2) offset(4), destination handle(2)
+# offset(4); handle 0 means a seg:off address in conventional memory
+xms_to:     # 32KB conventional -> XMS
+    .long 0x8000
+    .word 0
+    .word buffer, 0
+    .word 0
+    .long 0
+xms_from:   # 32KB XMS -> conventional
+    .long 0x8000
+    .word 0
+    .long 0
+    .word 0
+    .word buffer, 0
+
+.balign 16
+buffer:
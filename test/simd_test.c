@@ -0,0 +1,270 @@
+// Runs the IA-32 MMX and SSE2 handlers that have a host SSE2 version on
+// random register operands and prints the results. The GNUmakefile builds
+// this twice, with and without NO_HOST_SIMD, and compares the outputs, so
+// the host kernels are checked bit for bit against the lane loops.
+
+#include <compiler.h>
+#include <ia32/cpu.h>
+#include "ia32/instructions/mmx/mmx.h"
+#include "ia32/instructions/sse/sse.h"
+#include "ia32/instructions/sse2/sse2.h"
+
+#include <inttypes.h>
+
+// Number of random operand sets per instruction
+#define TEST_ROUNDS 4096
+
+// CPU state used by the handlers
+I386CORE i386core;
+I386CPUID i386cpuid;
+UINT32 *reg32_b20[0x100];
+UINT32 *reg32_b53[0x100];
+UINT32 (*calc_ea_dst_tbl[0x100])(void);
+UINT32 (*calc_ea32_dst_tbl[0x100])(void);
+
+// The ModRM byte of the instruction being tested
+static UINT8 modrm;
+
+UINT8 MEMCALL cpu_codefetch(UINT32 offset)
+{
+    return modrm;
+}
+
+// Only register operands are tested, nothing else should be reached
+static void unexpected(const char *name)
+{
+    fprintf(stderr, "simd_test: unexpected call to %s\n", name);
+    exit(1);
+}
+
+void CPUCALL exception(int num, int vec)
+{
+    fprintf(stderr, "simd_test: exception %d\n", num);
+    exit(1);
+}
+
+UINT16 MEMCALL cpu_vmemoryread_w(int idx, UINT32 offset)
+{
+    unexpected("cpu_vmemoryread_w");
+    return 0;
+}
+
+UINT32 MEMCALL cpu_vmemoryread_d(int idx, UINT32 offset)
+{
+    unexpected("cpu_vmemoryread_d");
+    return 0;
+}
+
+UINT64 MEMCALL cpu_vmemoryread_q(int idx, UINT32 offset)
+{
+    unexpected("cpu_vmemoryread_q");
+    return 0;
+}
+
+void MEMCALL cpu_vmemorywrite_b(int idx, UINT32 offset, UINT8 value)
+{
+    unexpected("cpu_vmemorywrite_b");
+}
+
+void MEMCALL cpu_vmemorywrite_d(int idx, UINT32 offset, UINT32 value)
+{
+    unexpected("cpu_vmemorywrite_d");
+}
+
+void MEMCALL cpu_vmemorywrite_q(int idx, UINT32 offset, UINT64 value)
+{
+    unexpected("cpu_vmemorywrite_q");
+}
+
+float SSE_ROUND(float val)
+{
+    unexpected("SSE_ROUND");
+    return val;
+}
+
+#define SSE_STUB(name)                                                         \
+    void name(void)                                                            \
+    {                                                                          \
+        unexpected(#name);                                                     \
+    }
+SSE_STUB(SSE_ANDNPS)
+SSE_STUB(SSE_ANDPS)
+SSE_STUB(SSE_COMISS)
+SSE_STUB(SSE_MOVAPSmem2xmm)
+SSE_STUB(SSE_MOVAPSxmm2mem)
+SSE_STUB(SSE_MOVHPSmem2xmm)
+SSE_STUB(SSE_MOVHPSxmm2mem)
+SSE_STUB(SSE_MOVLPSmem2xmm)
+SSE_STUB(SSE_MOVLPSxmm2mem)
+SSE_STUB(SSE_MOVNTPS)
+SSE_STUB(SSE_ORPS)
+SSE_STUB(SSE_XORPS)
+
+// Fixed seed, so both builds see the same operands
+static uint64_t rnd_state = 0x2545F4914F6CDD1DULL;
+
+static uint64_t rnd(void)
+{
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return rnd_state;
+}
+
+// Random lanes, often at the limits to exercise saturation and compares
+static uint64_t rnd_int(void)
+{
+    static const uint8_t edge[] = {0x00, 0x01, 0x7f, 0x80, 0xfe, 0xff};
+    uint64_t v = rnd();
+    if(rnd() & 1)
+        return v;
+    for(int i = 0; i < 8; i++)
+    {
+        if(rnd() & 1)
+        {
+            v &= ~(0xffULL << (i * 8));
+            v |= (uint64_t)edge[rnd() % sizeof(edge)] << (i * 8);
+        }
+    }
+    return v;
+}
+
+// Random doubles, including zeros, infinities, NaNs and denormals
+static uint64_t rnd_double(void)
+{
+    static const uint64_t special[] = {
+        0x0000000000000000ULL, 0x8000000000000000ULL, 0x7ff0000000000000ULL,
+        0xfff0000000000000ULL, 0x7ff8000000000000ULL, 0x7ff4000000000001ULL,
+        0xfff8000000000123ULL, 0x000fffffffffffffULL, 0x8000000000000001ULL,
+        0x3ff0000000000000ULL, 0x7fefffffffffffffULL};
+    uint64_t v = rnd();
+    switch(rnd() % 4)
+    {
+    case 0:
+        return special[rnd() % (sizeof(special) / sizeof(special[0]))];
+    case 1:
+        // Limit the exponent to normal numbers around 1.0
+        return (v & 0x800fffffffffffffULL) | ((0x3c0ULL + (v >> 52) % 0x80) << 52);
+    default:
+        return v;
+    }
+}
+
+enum op_type
+{
+    OP_MMX,
+    OP_XMM_INT,
+    OP_XMM_DOUBLE,
+};
+
+struct op
+{
+    const char *name;
+    void (*func)(void);
+    enum op_type type;
+};
+
+#define MMX(name) {#name, name, OP_MMX}
+#define XMMI(name) {#name, name, OP_XMM_INT}
+#define XMMD(name) {#name, name, OP_XMM_DOUBLE}
+
+static const struct op ops[] = {
+    MMX(MMX_PACKSSWB),      MMX(MMX_PACKSSDW),      MMX(MMX_PACKUSWB),
+    MMX(MMX_PADDB),         MMX(MMX_PADDW),         MMX(MMX_PADDD),
+    MMX(MMX_PADDSB),        MMX(MMX_PADDSW),        MMX(MMX_PADDUSB),
+    MMX(MMX_PADDUSW),       MMX(MMX_PCMPEQB),       MMX(MMX_PCMPEQW),
+    MMX(MMX_PCMPEQD),       MMX(MMX_PCMPGTB),       MMX(MMX_PCMPGTW),
+    MMX(MMX_PCMPGTD),       MMX(MMX_PMULHW),        MMX(MMX_PMULLW),
+    MMX(MMX_PSUBB),         MMX(MMX_PSUBW),         MMX(MMX_PSUBD),
+    MMX(MMX_PSUBSB),        MMX(MMX_PSUBSW),        MMX(MMX_PSUBUSB),
+    MMX(MMX_PSUBUSW),       MMX(MMX_PUNPCKHBW),     MMX(MMX_PUNPCKHWD),
+    MMX(MMX_PUNPCKLBW),     MMX(MMX_PUNPCKLWD),     XMMD(SSE2_ADDPD),
+    XMMD(SSE2_DIVPD),       XMMD(SSE2_MULPD),       XMMD(SSE2_SQRTPD),
+    XMMD(SSE2_SUBPD),       XMMI(SSE2_PACKSSDW),    XMMI(SSE2_PACKSSWB),
+    XMMI(SSE2_PACKUSWB),    XMMI(SSE2_PADDQxmm),    XMMI(SSE2_PADDB),
+    XMMI(SSE2_PADDW),       XMMI(SSE2_PADDD),       XMMI(SSE2_PADDSB),
+    XMMI(SSE2_PADDSW),      XMMI(SSE2_PADDUSB),     XMMI(SSE2_PADDUSW),
+    XMMI(SSE2_PAVGB),       XMMI(SSE2_PAVGW),       XMMI(SSE2_PCMPEQB),
+    XMMI(SSE2_PCMPEQW),     XMMI(SSE2_PCMPEQD),     XMMI(SSE2_PCMPGTB),
+    XMMI(SSE2_PCMPGTW),     XMMI(SSE2_PCMPGTD),     XMMI(SSE2_PMAXSW),
+    XMMI(SSE2_PMAXUB),      XMMI(SSE2_PMINSW),      XMMI(SSE2_PMINUB),
+    XMMI(SSE2_PMULHUW),     XMMI(SSE2_PMULHW),      XMMI(SSE2_PMULLW),
+    XMMI(SSE2_PMULUDQxmm),  XMMI(SSE2_PSUBQxmm),    XMMI(SSE2_PSUBB),
+    XMMI(SSE2_PSUBW),       XMMI(SSE2_PSUBD),       XMMI(SSE2_PSUBSB),
+    XMMI(SSE2_PSUBSW),      XMMI(SSE2_PSUBUSB),     XMMI(SSE2_PSUBUSW),
+    XMMI(SSE2_PUNPCKHBW),   XMMI(SSE2_PUNPCKHWD),   XMMI(SSE2_PUNPCKHDQ),
+    XMMI(SSE2_PUNPCKLBW),   XMMI(SSE2_PUNPCKLWD),   XMMI(SSE2_PUNPCKLDQ),
+};
+
+static int is_nan(uint64_t v)
+{
+    return (v & 0x7ff0000000000000ULL) == 0x7ff0000000000000ULL &&
+           (v & 0x000fffffffffffffULL) != 0;
+}
+
+// Which NaN a C addition or multiplication returns when both operands are
+// NaN depends on the order the compiler puts the operands in, so only check
+// that the result is a NaN in that case.
+static uint64_t nan_lane(uint64_t res, uint64_t a, uint64_t b)
+{
+    if(is_nan(a) && is_nan(b) && is_nan(res))
+        return 0x7ff8000000000000ULL;
+    return res;
+}
+
+// Runs one instruction with random operands, prints the destination.
+static void run_op(const struct op *op)
+{
+    XMM_REG a, b;
+    unsigned idx = rnd() % 8;
+    // Use the same register for both operands from time to time
+    unsigned sub = (rnd() % 8 == 0) ? idx : rnd() % 8;
+
+    for(int i = 0; i < 8; i++)
+    {
+        if(op->type == OP_MMX)
+        {
+            FPU_STAT.reg[i].ll = rnd_int();
+            FPU_STAT.reg[i].ul.ext = 0xffff;
+        }
+        else if(op->type == OP_XMM_INT)
+        {
+            FPU_STAT.xmm_reg[i].ul64[0] = rnd_int();
+            FPU_STAT.xmm_reg[i].ul64[1] = rnd_int();
+        }
+        else
+        {
+            FPU_STAT.xmm_reg[i].ul64[0] = rnd_double();
+            FPU_STAT.xmm_reg[i].ul64[1] = rnd_double();
+        }
+    }
+    a = FPU_STAT.xmm_reg[idx];
+    b = FPU_STAT.xmm_reg[sub];
+    modrm = 0xc0 | (idx << 3) | sub;
+    CPU_EIP = 0;
+    op->func();
+
+    if(op->type == OP_XMM_DOUBLE)
+        for(int i = 0; i < 2; i++)
+            FPU_STAT.xmm_reg[idx].ul64[i] =
+                nan_lane(FPU_STAT.xmm_reg[idx].ul64[i], a.ul64[i], b.ul64[i]);
+
+    if(op->type == OP_MMX)
+        printf("%s %u,%u: %016" PRIx64 "\n", op->name, idx, sub,
+               (uint64_t)FPU_STAT.reg[idx].ll);
+    else
+        printf("%s %u,%u: %016" PRIx64 "%016" PRIx64 "\n", op->name, idx, sub,
+               FPU_STAT.xmm_reg[idx].ul64[1], FPU_STAT.xmm_reg[idx].ul64[0]);
+}
+
+int main(void)
+{
+#if !defined(USE_HOST_SSE2) && !defined(NO_HOST_SIMD)
+    fprintf(stderr, "simd_test: no host SSE2, only the lane loops are built\n");
+#endif
+    i386cpuid.cpu_feature = CPU_FEATURE_MMX | CPU_FEATURE_SSE | CPU_FEATURE_SSE2;
+    for(unsigned i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+        for(int n = 0; n < TEST_ROUNDS; n++)
+            run_op(&ops[i]);
+    return 0;
+}